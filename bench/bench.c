@@ -0,0 +1,639 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Microbenchmarks of the kernels the calculations spend their time in. Each
+ * benchmark is run with more and more operations until it has taken at least
+ * a fifth of a second, and its time and allocations per operation are
+ * reported. The allocations are counted by wrapping malloc, calloc and
+ * realloc at link time, see the bench target of the makefile.
+ */
+
+#include "TransverseHFK.h"
+
+#define MIN_SECONDS 0.2
+#define MAX_OPS 100000000L
+#define POOL_SIZE 256
+#define BATCH_SIZE 4096
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+void *__wrap_malloc(size_t);
+void *__wrap_calloc(size_t, size_t);
+void *__wrap_realloc(void *, size_t);
+
+static unsigned long allocations = 0;
+
+struct Bench {
+  long ops;
+  int running;
+  double seconds;
+  unsigned long allocations;
+  struct timespec started;
+  unsigned long allocations_started;
+};
+
+typedef void (*bench_fn)(struct Bench *);
+
+struct BenchCase {
+  const char *name;
+  bench_fn fn;
+};
+
+static void start_timer(struct Bench *);
+static void stop_timer(struct Bench *);
+static void run_case(const struct BenchCase *);
+static unsigned int next_random(void);
+static void random_state(State, const int);
+static State *random_states(const int, const int);
+static void free_states(State *, const int);
+static StateRBTree random_tree(const int, const int);
+static EdgeList random_edges(const int, const int);
+static EdgeList layered_edges(const int, const int);
+static LiftState *lift_pool(const LiftGrid_t *const, int *);
+
+static void bench_rectangles_out_of(struct Bench *);
+static void bench_rectangles_into(struct Bench *);
+static void bench_fixed_wt_rectangles(struct Bench *);
+static void bench_lift_rectangles(struct Bench *, const int, const int);
+static void bench_lift_out_of_2(struct Bench *);
+static void bench_lift_out_of_3(struct Bench *);
+static void bench_lift_out_of_4(struct Bench *);
+static void bench_lift_into_2(struct Bench *);
+static void bench_lift_into_3(struct Bench *);
+static void bench_lift_into_4(struct Bench *);
+static void bench_tree_insert(struct Bench *);
+static void bench_tree_find(struct Bench *);
+static void bench_tree_iterate(struct Bench *);
+static void bench_hash_set_insert(struct Bench *);
+static void bench_hash_set_find(struct Bench *);
+static void bench_hash_set_iterate(struct Bench *);
+static void bench_state_table_intern(struct Bench *);
+static void bench_state_table_find(struct Bench *);
+static void bench_merge_sort_edges(struct Bench *);
+static void bench_special_homology(struct Bench *);
+
+static char bench_Xs[] = {10, 5, 8, 6, 3, 7, 2, 4, 9, 1};
+static char bench_Os[] = {7, 9, 3, 4, 5, 1, 6, 10, 2, 8};
+static const Grid_t bench_grid = {bench_Xs, bench_Os, 10};
+
+static char lift_Xs[] = {3, 2, 5, 4, 1, 7, 6};
+static char lift_Os[] = {1, 4, 3, 7, 6, 5, 2};
+
+static unsigned int seed = 1;
+
+static const struct BenchCase cases[] = {
+    {"new_rectangles_out_of", bench_rectangles_out_of},
+    {"new_rectangles_into", bench_rectangles_into},
+    {"fixed_wt_rectangles_out_of", bench_fixed_wt_rectangles},
+    {"new_lift_rectangles_out_of/2", bench_lift_out_of_2},
+    {"new_lift_rectangles_out_of/3", bench_lift_out_of_3},
+    {"new_lift_rectangles_out_of/4", bench_lift_out_of_4},
+    {"new_lift_rectangles_into/2", bench_lift_into_2},
+    {"new_lift_rectangles_into/3", bench_lift_into_3},
+    {"new_lift_rectangles_into/4", bench_lift_into_4},
+    {"rbtree_insert", bench_tree_insert},
+    {"rbtree_find", bench_tree_find},
+    {"rbtree_iterate", bench_tree_iterate},
+    {"hash_set_insert", bench_hash_set_insert},
+    {"hash_set_find", bench_hash_set_find},
+    {"hash_set_iterate", bench_hash_set_iterate},
+    {"state_table_intern", bench_state_table_intern},
+    {"state_table_find", bench_state_table_find},
+    {"merge_sort_edges/1000", bench_merge_sort_edges},
+    {"special_homology/200", bench_special_homology}};
+
+/**
+ * Runs the benchmarks whose names contain the first argument, or all of them
+ */
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : "";
+
+  printf("%-30s %12s %14s %12s\n", "benchmark", "ops", "ns/op", "allocs/op");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    if (NULL != strstr(cases[i].name, filter)) {
+      run_case(&cases[i]);
+    }
+  }
+  print_allocations(stdout);
+  return 0;
+}
+
+void *__wrap_malloc(size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(p, size);
+}
+
+/**
+ * Starts or resumes timing b and counting its allocations
+ * @param b a benchmark
+ */
+static void start_timer(struct Bench *b) {
+  b->running = 1;
+  b->allocations_started = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+  clock_gettime(CLOCK_MONOTONIC, &b->started);
+}
+
+/**
+ * Pauses timing b, so that set up between operations is left out
+ * @param b a benchmark
+ */
+static void stop_timer(struct Bench *b) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (b->running) {
+    b->seconds += (now.tv_sec - b->started.tv_sec) +
+                  (now.tv_nsec - b->started.tv_nsec) / 1e9;
+    b->allocations += __atomic_load_n(&allocations, __ATOMIC_RELAXED) -
+                      b->allocations_started;
+    b->running = 0;
+  }
+}
+
+/**
+ * Runs a benchmark with 1, 10, 100, ... operations until it takes at least
+ * MIN_SECONDS and prints its time and allocations per operation
+ * @param c a benchmark
+ */
+static void run_case(const struct BenchCase *c) {
+  struct Bench b;
+  b.ops = 1;
+
+  for (;;) {
+    b.running = 0;
+    b.seconds = 0;
+    b.allocations = 0;
+    seed = 1;
+    c->fn(&b);
+    stop_timer(&b);
+    if (b.seconds >= MIN_SECONDS || b.ops >= MAX_OPS) {
+      break;
+    }
+    b.ops *= 10;
+  }
+
+  printf("%-30s %12ld %14.1f %12.2f\n", c->name, b.ops, 1e9 * b.seconds / b.ops,
+         (double)b.allocations / b.ops);
+  fflush(stdout);
+}
+
+/**
+ * A xorshift generator, so that every run sees the same inputs
+ * @return a pseudo random number
+ */
+static unsigned int next_random(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/**
+ * Fills state with a uniformly random permutation of 1, ..., n
+ * @param state a state of length n
+ * @param n the arc index
+ */
+static void random_state(State state, const int n) {
+  for (int i = 0; i < n; ++i) {
+    state[i] = (char)(i + 1);
+  }
+  for (int i = n - 1; i > 0; --i) {
+    const int j = (int)(next_random() % (i + 1));
+    const char temp = state[i];
+    state[i] = state[j];
+    state[j] = temp;
+  }
+}
+
+/**
+ * @param count the number of states
+ * @param n the arc index
+ * @return an array of count random states
+ */
+static State *random_states(const int count, const int n) {
+  State *states = malloc(sizeof(State) * count);
+  for (int i = 0; i < count; ++i) {
+    states[i] = malloc(sizeof(char) * n);
+    random_state(states[i], n);
+  }
+  return states;
+}
+
+/**
+ * Frees an array of states along with the states that are not NULL
+ * @param states an array of states
+ * @param count the length of states
+ */
+static void free_states(State *states, const int count) {
+  for (int i = 0; i < count; ++i) {
+    free(states[i]);
+  }
+  free(states);
+}
+
+/**
+ * @param count the number of random states to insert
+ * @param n the arc index
+ * @return a tree of at most count random states of bench_grid
+ */
+static StateRBTree random_tree(const int count, const int n) {
+  StateRBTree tree = EMPTY_TREE;
+  for (int i = 0; i < count; ++i) {
+    State s = malloc(sizeof(char) * n);
+    random_state(s, n);
+    if (s_is_member(&tree, s, &bench_grid)) {
+      free(s);
+    } else {
+      s_insert_data(&tree, s, &bench_grid);
+    }
+  }
+  return tree;
+}
+
+/**
+ * @param count the number of edges
+ * @param vertices the number of vertices
+ * @return an unsorted list of count random edges
+ */
+static EdgeList random_edges(const int count, const int vertices) {
+  EdgeList edges = NULL;
+  for (int i = 0; i < count; ++i) {
+    edges = prepend_edge((int)(next_random() % vertices),
+                         (int)(next_random() % vertices), edges);
+  }
+  return edges;
+}
+
+/**
+ * Builds a sorted edge list shaped like the complexes: the vertices are split
+ * into layers of the given width and each vertex has three edges into random
+ * vertices of the next layer, the odd layers numbered from vertex 0 as the A
+ * layers are and the even ones after them as the B layers are.
+ * @param vertices the number of vertices
+ * @param width the number of vertices of each layer
+ * @return the edge list
+ */
+static EdgeList layered_edges(const int vertices, const int width) {
+  EdgeList edges = NULL;
+  for (int v = 0; v + width < vertices; ++v) {
+    const int next = (v / width + 1) * width;
+    for (int k = 0; k < 3; ++k) {
+      edges = prepend_edge(v, next + (int)(next_random() % width), edges);
+    }
+  }
+  return merge_sort_edges(edges);
+}
+
+/**
+ * Builds a pool of lift states of G by a breadth first walk along rectangles
+ * into the upper right state, as the A layers of the lift are built
+ * @param G a lift grid
+ * @param count destination for the number of states in the pool
+ * @return an array of the states
+ */
+static LiftState *lift_pool(const LiftGrid_t *const G, int *count) {
+  LiftState *pool = malloc(sizeof(LiftState) * POOL_SIZE);
+  const int n = G->arc_index;
+
+  init_lift_state(&pool[0], G);
+  for (int j = 0; j < G->sheets; ++j) {
+    for (int i = 0; i < n; ++i) {
+      const int x = G->Xs[(i + n - 1) % n];
+      pool[0][j][i] = (char)(x == n ? 1 : x + 1);
+    }
+  }
+  *count = 1;
+
+  for (int i = 0; i < *count && *count < POOL_SIZE; ++i) {
+    LiftStateRBTree found =
+        new_lift_rectangles_into(EMPTY_LIFT_TREE, pool[i], G);
+    LiftTreeIter_t *iter;
+    for (iter = create_iter(found); has_next(iter) && *count < POOL_SIZE;) {
+      LiftStateRBTree node = get_next(iter);
+      init_lift_state(&pool[*count], G);
+      copy_lift_state(&pool[*count], &node->data, G);
+      (*count)++;
+    }
+    free_iter(iter);
+    free_lift_state_rbtree(&found, G);
+  }
+  return pool;
+}
+
+static void bench_rectangles_out_of(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  State *states = random_states(POOL_SIZE, n);
+  StateRBTree prevs = random_tree(POOL_SIZE, n);
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    StateRBTree found =
+        new_rectangles_out_of(prevs, states[i % POOL_SIZE], &bench_grid);
+    free_state_rbtree(&found);
+  }
+  stop_timer(b);
+
+  free_state_rbtree(&prevs);
+  free_states(states, POOL_SIZE);
+}
+
+static void bench_rectangles_into(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  State *states = random_states(POOL_SIZE, n);
+  StateRBTree prevs = random_tree(POOL_SIZE, n);
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    StateRBTree found =
+        new_rectangles_into(prevs, states[i % POOL_SIZE], &bench_grid);
+    free_state_rbtree(&found);
+  }
+  stop_timer(b);
+
+  free_state_rbtree(&prevs);
+  free_states(states, POOL_SIZE);
+}
+
+static void bench_fixed_wt_rectangles(struct Bench *b) {
+  State *states = random_states(POOL_SIZE, bench_grid.arc_index);
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    free_state_list(
+        fixed_wt_rectangles_out_of(1, states[i % POOL_SIZE], &bench_grid));
+  }
+  stop_timer(b);
+
+  free_states(states, POOL_SIZE);
+}
+
+/**
+ * Enumerates the rectangles out of or into the states of a pool of lift
+ * states
+ * @param b a benchmark
+ * @param sheets the number of sheets of the lift
+ * @param into nonzero for rectangles into the states, zero for out of
+ */
+static void bench_lift_rectangles(struct Bench *b, const int sheets,
+                                  const int into) {
+  const LiftGrid_t G = {lift_Xs, lift_Os, 7, sheets};
+  int count;
+  LiftState *pool = lift_pool(&G, &count);
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    LiftStateRBTree found =
+        into ? new_lift_rectangles_into(EMPTY_LIFT_TREE, pool[i % count], &G)
+             : new_lift_rectangles_out_of(EMPTY_LIFT_TREE, pool[i % count], &G);
+    free_lift_state_rbtree(&found, &G);
+  }
+  stop_timer(b);
+
+  for (int i = 0; i < count; ++i) {
+    free_lift_state(&pool[i], &G);
+  }
+  free(pool);
+}
+
+static void bench_lift_out_of_2(struct Bench *b) {
+  bench_lift_rectangles(b, 2, 0);
+}
+
+static void bench_lift_out_of_3(struct Bench *b) {
+  bench_lift_rectangles(b, 3, 0);
+}
+
+static void bench_lift_out_of_4(struct Bench *b) {
+  bench_lift_rectangles(b, 4, 0);
+}
+
+static void bench_lift_into_2(struct Bench *b) {
+  bench_lift_rectangles(b, 2, 1);
+}
+
+static void bench_lift_into_3(struct Bench *b) {
+  bench_lift_rectangles(b, 3, 1);
+}
+
+static void bench_lift_into_4(struct Bench *b) {
+  bench_lift_rectangles(b, 4, 1);
+}
+
+static void bench_tree_insert(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateRBTree tree = EMPTY_TREE;
+
+  // The states are made in batches outside the timer
+  for (long done = 0; done < b->ops; done += BATCH_SIZE) {
+    const int batch = (int)(b->ops - done < BATCH_SIZE ? b->ops - done
+                                                        : BATCH_SIZE);
+    State *states = random_states(batch, n);
+    start_timer(b);
+    for (int i = 0; i < batch; ++i) {
+      if (!s_is_member(&tree, states[i], &bench_grid)) {
+        s_insert_data(&tree, states[i], &bench_grid);
+        states[i] = NULL;
+      }
+    }
+    stop_timer(b);
+    free_states(states, batch);
+  }
+  free_state_rbtree(&tree);
+}
+
+static void bench_tree_find(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  State *states = random_states(BATCH_SIZE, n);
+  StateRBTree tree = random_tree(65536, n);
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    s_is_member(&tree, states[i % BATCH_SIZE], &bench_grid);
+  }
+  stop_timer(b);
+
+  free_state_rbtree(&tree);
+  free_states(states, BATCH_SIZE);
+}
+
+static void bench_tree_iterate(struct Bench *b) {
+  StateRBTree tree = random_tree(65536, bench_grid.arc_index);
+  StateTreeIter_t *iter = NULL;
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    if (NULL == iter || !s_has_next(iter)) {
+      if (NULL != iter) {
+        s_free_iter(iter);
+      }
+      iter = s_create_iter(tree);
+    }
+    s_get_next(iter);
+  }
+  stop_timer(b);
+
+  s_free_iter(iter);
+  free_state_rbtree(&tree);
+}
+
+static void bench_hash_set_insert(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateHashSet_t *set = create_hash_set(b->ops, n);
+  int tag;
+
+  for (long done = 0; done < b->ops; done += BATCH_SIZE) {
+    const int batch = (int)(b->ops - done < BATCH_SIZE ? b->ops - done
+                                                        : BATCH_SIZE);
+    State *states = random_states(batch, n);
+    start_timer(b);
+    for (int i = 0; i < batch; ++i) {
+      if (hash_set_insert(set, states[i], &tag)) {
+        states[i] = NULL;
+      }
+    }
+    stop_timer(b);
+    free_states(states, batch);
+  }
+  free_hash_set(set);
+}
+
+static void bench_hash_set_find(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateHashSet_t *set = create_hash_set(65536, n);
+  State *states = random_states(BATCH_SIZE, n);
+  int tag;
+
+  for (int i = 0; i < 65536; ++i) {
+    State t = malloc(sizeof(char) * n);
+    random_state(t, n);
+    if (!hash_set_insert(set, t, &tag)) {
+      free(t);
+    }
+  }
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    hash_set_tag(set, states[i % BATCH_SIZE]);
+  }
+  stop_timer(b);
+
+  free_hash_set(set);
+  free_states(states, BATCH_SIZE);
+}
+
+static void bench_hash_set_iterate(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateHashSet_t *set = create_hash_set(65536, n);
+  long visited = 0, slot = 0;
+  int tag;
+
+  for (int i = 0; i < 65536; ++i) {
+    State t = malloc(sizeof(char) * n);
+    random_state(t, n);
+    if (!hash_set_insert(set, t, &tag)) {
+      free(t);
+    }
+  }
+
+  // An operation visits one state, skipping the empty slots before it
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    do {
+      slot = (slot + 1) & (set->capacity - 1);
+    } while (NULL == set->keys[slot]);
+    visited += set->tags[slot];
+  }
+  stop_timer(b);
+
+  free_hash_set(set);
+  if (0 == visited) {
+    printf("%ld\n", visited);
+  }
+}
+
+static void bench_state_table_intern(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateTable_t *table = create_state_table(n);
+  int id;
+
+  for (long done = 0; done < b->ops; done += BATCH_SIZE) {
+    const int batch = (int)(b->ops - done < BATCH_SIZE ? b->ops - done
+                                                        : BATCH_SIZE);
+    State *states = random_states(batch, n);
+    start_timer(b);
+    for (int i = 0; i < batch; ++i) {
+      state_table_intern(table, states[i], &id);
+    }
+    stop_timer(b);
+    free_states(states, batch);
+  }
+  free_state_table(table);
+}
+
+static void bench_state_table_find(struct Bench *b) {
+  const int n = bench_grid.arc_index;
+  StateTable_t *table = create_state_table(n);
+  State *states = random_states(BATCH_SIZE, n);
+  State t = malloc(sizeof(char) * n);
+  int id;
+
+  for (int i = 0; i < 65536; ++i) {
+    random_state(t, n);
+    state_table_intern(table, t, &id);
+  }
+
+  start_timer(b);
+  for (long i = 0; i < b->ops; ++i) {
+    state_table_id(table, states[i % BATCH_SIZE]);
+  }
+  stop_timer(b);
+
+  free(t);
+  free_state_table(table);
+  free_states(states, BATCH_SIZE);
+}
+
+static void bench_merge_sort_edges(struct Bench *b) {
+  for (long i = 0; i < b->ops; ++i) {
+    EdgeList edges = random_edges(1000, 500);
+    start_timer(b);
+    edges = merge_sort_edges(edges);
+    stop_timer(b);
+    free_edge_list(edges);
+  }
+}
+
+static void bench_special_homology(struct Bench *b) {
+  for (long i = 0; i < b->ops; ++i) {
+    EdgeList edges = layered_edges(200, 20);
+    start_timer(b);
+    special_homology(0, 199, &edges, NULL);
+    stop_timer(b);
+    free_edge_list(edges);
+  }
+}
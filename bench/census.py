@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, version 3.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+"""
+
+# Times every line of the grid census files in a process of its own and
+# records the wall time, the peak resident memory and the number of states
+# explored by the line. With --record the measurements are written to the
+# baseline file, and otherwise they are compared with it and the lines that
+# got slower, bigger or explored more states than the threshold allows are
+# reported.
+
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+CENSUS = ['test/grid_7.in', 'test/grid_7_2sheets.in',
+          'test/grid_7_3sheets.in', 'test/grid_7_4sheets.in',
+          'test/lift1-4.in']
+
+
+def run_line(executable, args, telemetry):
+    """
+    Runs one line of a census file
+
+    Returns the wall time in seconds, the peak resident memory in kB and the
+    number of states of the layers the line built. The memory is the largest
+    the telemetry recorded after a layer, since the resident memory of a
+    child also counts the memory of this script before the child ran the
+    executable.
+    """
+    argv = [executable] + shlex.split(args) + ['-L', telemetry]
+    with open(os.devnull, 'w') as null:
+        start = time.monotonic()
+        status = subprocess.call(argv, stdout=null, stderr=null)
+        seconds = time.monotonic() - start
+
+    if 0 != status:
+        raise RuntimeError('%s exited with status %d' % (' '.join(argv),
+                                                          status))
+
+    rss = 0
+    states = 0
+    with open(telemetry) as f:
+        for line in f:
+            layer = json.loads(line)
+            rss = max(rss, layer['rss_kb'])
+            states += layer['states']
+    return seconds, rss, states
+
+
+def read_baseline(path):
+    """
+    Reads a baseline file into a dict from the line keys to their
+    measurements
+    """
+    baseline = {}
+    with open(path) as f:
+        for line in f:
+            if line.startswith('#') or not line.strip():
+                continue
+            key, seconds, rss, states = line.split('\t')
+            baseline[key] = (float(seconds), int(rss), int(states))
+    return baseline
+
+
+def write_baseline(path, results):
+    """
+    Writes the measurements to a baseline file, one line of the census per
+    line
+    """
+    with open(path, 'w') as f:
+        f.write('# line\tseconds\trss_kb\tstates\n')
+        for key, (seconds, rss, states) in results:
+            f.write('%s\t%.6f\t%d\t%d\n' % (key, seconds, rss, states))
+
+
+def regressions(key, measured, base, threshold, min_seconds):
+    """
+    Compares a line with its baseline
+
+    Returns a description of each measurement that grew by more than the
+    threshold. Times that grew by less than min_seconds are not reported, so
+    that quick lines do not report noise.
+    """
+    seconds, rss, states = measured
+    base_seconds, base_rss, base_states = base
+    found = []
+    if (seconds > base_seconds * (1 + threshold) and
+            seconds - base_seconds >= min_seconds):
+        found.append('%s: %.3f s, was %.3f s' % (key, seconds, base_seconds))
+    if rss > base_rss * (1 + threshold):
+        found.append('%s: %d kB, was %d kB' % (key, rss, base_rss))
+    if states > base_states * (1 + threshold):
+        found.append('%s: %d states, was %d' % (key, states, base_states))
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Times the grid census and compares it with a baseline')
+    parser.add_argument('files', nargs='*', default=CENSUS,
+                        help='census files, one grid per line')
+    parser.add_argument('-e', '--executable', default='build/transverseHFK',
+                        help='the transverseHFK to time')
+    parser.add_argument('-b', '--baseline', default='build/census.baseline',
+                        help='the baseline file')
+    parser.add_argument('-r', '--record', action='store_true',
+                        help='write the baseline instead of comparing')
+    parser.add_argument('-n', '--lines', type=int, default=0,
+                        help='time only the first LINES lines of each file')
+    parser.add_argument('-t', '--threshold', type=float, default=0.2,
+                        help='the growth reported as a regression, 0.2 '
+                        'for 20%%')
+    parser.add_argument('-m', '--min-seconds', type=float, default=0.05,
+                        help='the smallest slow down reported')
+    parser.add_argument('-v', '--verbose', action='store_true',
+                        help='print the measurements of every line')
+    args = parser.parse_args()
+
+    baseline = {}
+    if not args.record:
+        if not os.path.exists(args.baseline):
+            sys.exit('No baseline %s, make one with --record' % args.baseline)
+        baseline = read_baseline(args.baseline)
+
+    fd, telemetry = tempfile.mkstemp(suffix='.jsonl')
+    os.close(fd)
+    results = []
+    found = []
+    try:
+        for path in args.files:
+            total = [0.0, 0, 0]
+            with open(path) as f:
+                lines = [line.strip() for line in f]
+            if args.lines > 0:
+                lines = lines[:args.lines]
+            for number, line in enumerate(lines, 1):
+                if not line:
+                    continue
+                key = '%s:%d' % (os.path.basename(path), number)
+                measured = run_line(args.executable, line, telemetry)
+                results.append((key, measured))
+                total[0] += measured[0]
+                total[1] = max(total[1], measured[1])
+                total[2] += measured[2]
+                if args.verbose:
+                    print('%-28s %10.3f s %10d kB %12d states' %
+                          ((key,) + measured))
+                if key in baseline:
+                    found += regressions(key, measured, baseline[key],
+                                         args.threshold, args.min_seconds)
+            print('%-28s %10.3f s %10d kB %12d states' %
+                  ((os.path.basename(path),) + tuple(total)))
+    finally:
+        os.remove(telemetry)
+
+    if args.record:
+        write_baseline(args.baseline, results)
+        print('Recorded %d lines in %s' % (len(results), args.baseline))
+        return 0
+
+    missing = sum(1 for key, _ in results if key not in baseline)
+    if missing:
+        print('%d lines are not in the baseline' % missing)
+    for regression in found:
+        print('REGRESSION %s' % regression)
+    print('%d regressions beyond %.0f%%' % (len(found),
+                                            100 * args.threshold))
+    return 1 if found else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
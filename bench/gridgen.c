@@ -0,0 +1,326 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Generates grids for stress and scaling runs, one set of transverseHFK
+ * arguments per line. Without -X and -O the grids are random knots;
+ * otherwise they are the given grid stabilized at random markings until
+ * they reach the arc index asked for. The same seed always gives the same
+ * grids.
+ */
+
+#include "gridmoves.h"
+#include <argp.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+
+#define MAX_ARC_INDEX 100
+
+const char *argp_program_version = "gridgen revision 1.0.0";
+static const char doc[] =
+    "Prints grid diagrams of knots as transverseHFK arguments, one grid per\
+ line. The grids are random knots of the arc index given, or with -X and -O\
+ that grid stabilized at random markings up to the arc index given. Every\
+ line ends in -S so that transverseHFK calculates on the grid as printed.";
+
+static const char args_doc[] = "-i <ArcIndex>[-<ArcIndex>]";
+
+static struct argp_option options[] = {
+    {"index", 'i', "ArcIndex", 0,
+     "Arc index of the grids, or a range LOW-HIGH of them", 0},
+    {"Xs", 'X', "[...]", 0, "List of Xs of a grid to stabilize", 0},
+    {"Os", 'O', "[...]", 0, "List of Os of a grid to stabilize", 0},
+    {"count", 'c', "COUNT", 0, "Number of grids of each arc index. Default: 1",
+     0},
+    {"seed", 'r', "SEED", 0, "Seed of the random grids. Default: 1", 0},
+    {"sheets", 'n', "SHEETS", 0,
+     "Number of sheets passed on to transverseHFK. Default: 1", 0},
+    {"simplify", 's', 0, 0,
+     "Leave out the -S so that transverseHFK simplifies the grids first", 0},
+    {0}};
+
+struct arguments {
+  int low;
+  int high;
+  int count;
+  unsigned int seed;
+  int sheets;
+  int simplify;
+  char *Xs;
+  char *Os;
+};
+
+static error_t parse_opt(int, char *, struct argp_state *);
+static int parse_permutation(State, int *, const char *);
+static unsigned int next_random(unsigned int *);
+static void random_knot(Grid_t *, unsigned int *);
+static void stabilize_to(Grid_t *, const int, unsigned int *);
+static void print_grid(const Grid_t *const, const struct arguments *);
+
+static struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
+
+int main(int argc, char **argv) {
+  struct arguments args;
+  Grid_t K, G;
+  char K_Xs[MAX_ARC_INDEX], K_Os[MAX_ARC_INDEX];
+  char Xs[MAX_ARC_INDEX], Os[MAX_ARC_INDEX];
+
+  args.low = 0;
+  args.high = 0;
+  args.count = 1;
+  args.seed = 1;
+  args.sheets = 1;
+  args.simplify = 0;
+  args.Xs = NULL;
+  args.Os = NULL;
+  if (0 != argp_parse(&argp, argc, argv, 0, 0, &args)) {
+    return 1;
+  }
+
+  K.Xs = K_Xs;
+  K.Os = K_Os;
+  K.arc_index = 0;
+  if (NULL != args.Xs || NULL != args.Os) {
+    int x_len, o_len;
+    if (NULL == args.Xs || NULL == args.Os) {
+      fprintf(stderr, "gridgen: A grid to stabilize needs both Xs and Os\n");
+      return 1;
+    }
+    if (-1 == parse_permutation(K.Xs, &x_len, args.Xs) ||
+        -1 == parse_permutation(K.Os, &o_len, args.Os) || x_len != o_len) {
+      fprintf(stderr, "gridgen: Malformatted Xs or Os\n");
+      return 1;
+    }
+    K.arc_index = x_len;
+    if (!is_grid(&K)) {
+      fprintf(stderr, "gridgen: Invalid grid\n");
+      return 1;
+    }
+    if (0 == args.low) {
+      args.low = args.high = K.arc_index;
+    }
+  }
+
+  if (0 == args.low) {
+    fprintf(stderr, "gridgen: Missing arc index\n");
+    return 1;
+  }
+  if (args.low < K.arc_index) {
+    fprintf(stderr, "gridgen: The arc index must be at least that of the "
+                    "grid, %d\n",
+            K.arc_index);
+    return 1;
+  }
+
+  G.Xs = Xs;
+  G.Os = Os;
+  for (int n = args.low; n <= args.high; ++n) {
+    // Each arc index has a generator of its own so that widening the range
+    // keeps the grids already printed
+    unsigned int seed = args.seed * 2654435761u + (unsigned int)n;
+    for (int i = 0; i < args.count; ++i) {
+      if (0 == K.arc_index) {
+        G.arc_index = n;
+        random_knot(&G, &seed);
+      } else {
+        G.arc_index = K.arc_index;
+        memcpy(G.Xs, K.Xs, K.arc_index);
+        memcpy(G.Os, K.Os, K.arc_index);
+        stabilize_to(&G, n, &seed);
+      }
+      if (!is_grid(&G)) {
+        fprintf(stderr, "gridgen: Generated an invalid grid\n");
+        return 1;
+      }
+      print_grid(&G, &args);
+    }
+  }
+
+  return 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *args = state->input;
+  char *end;
+
+  switch (key) {
+  case 'i':
+    errno = 0;
+    args->low = (int)strtol(arg, &end, 10);
+    args->high = args->low;
+    if ('-' == *end) {
+      args->high = (int)strtol(end + 1, &end, 10);
+    }
+    if (0 != errno || '\0' != *end || args->low < 2 ||
+        args->high < args->low || args->high > MAX_ARC_INDEX) {
+      argp_failure(state, 0, 0, "Invalid arc index");
+      return EINVAL;
+    }
+    break;
+  case 'X':
+    args->Xs = arg;
+    break;
+  case 'O':
+    args->Os = arg;
+    break;
+  case 'c':
+    args->count = atoi(arg);
+    if (args->count < 1) {
+      argp_failure(state, 0, 0, "Invalid count");
+      return EINVAL;
+    }
+    break;
+  case 'r':
+    args->seed = (unsigned int)strtoul(arg, NULL, 10);
+    break;
+  case 'n':
+    args->sheets = atoi(arg);
+    if (args->sheets < 1) {
+      argp_failure(state, 0, 0, "The number of sheets must be atleast 1.");
+      return EINVAL;
+    }
+    break;
+  case 's':
+    args->simplify = 1;
+    break;
+  default:
+    return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+/**
+ * Reads a list such as [3,1,2] into perm
+ * @param perm room for MAX_ARC_INDEX entries
+ * @param len destination for the length of the list
+ * @param str the list
+ * @return 0 on success, -1 if str is not a list of at most MAX_ARC_INDEX
+ * numbers from 1 to MAX_ARC_INDEX
+ */
+static int parse_permutation(State perm, int *len, const char *str) {
+  const char *s = str;
+  char *end;
+
+  if ('[' != *s++) {
+    return -1;
+  }
+  *len = 0;
+  for (;;) {
+    errno = 0;
+    const long n = strtol(s, &end, 10);
+    if (end == s || 0 != errno || n < 1 || n > MAX_ARC_INDEX ||
+        *len == MAX_ARC_INDEX) {
+      return -1;
+    }
+    perm[(*len)++] = (char)n;
+    s = end;
+    if (']' == *s) {
+      return ('\0' == s[1]) ? 0 : -1;
+    }
+    if (',' != *s++) {
+      return -1;
+    }
+  }
+}
+
+/**
+ * A xorshift generator
+ * @param seed the state of the generator, advanced
+ * @return a pseudo random number
+ */
+static unsigned int next_random(unsigned int *seed) {
+  if (0 == *seed) {
+    *seed = 1;
+  }
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+/**
+ * Fills G with a random knot of its arc index. The Xs are a random
+ * permutation and the Os are the Xs permuted by a random cycle through every
+ * column, which makes the grid a knot: the vertical segment of column i
+ * ends in the row of the X of the column the cycle takes i to.
+ * @param G a grid whose arc index is set, filled in place
+ * @param seed the state of the generator
+ */
+static void random_knot(Grid_t *G, unsigned int *seed) {
+  const int n = G->arc_index;
+  int cycle[MAX_ARC_INDEX];
+
+  for (int i = 0; i < n; ++i) {
+    G->Xs[i] = (char)(i + 1);
+    cycle[i] = i;
+  }
+  for (int i = n - 1; i > 0; --i) {
+    const int j = (int)(next_random(seed) % (i + 1));
+    const char temp = G->Xs[i];
+    G->Xs[i] = G->Xs[j];
+    G->Xs[j] = temp;
+  }
+  // Sattolo's shuffle gives a uniformly random cycle of length n
+  for (int i = n - 1; i > 0; --i) {
+    const int j = (int)(next_random(seed) % i);
+    const int temp = cycle[i];
+    cycle[i] = cycle[j];
+    cycle[j] = temp;
+  }
+  for (int i = 0; i < n; ++i) {
+    G->Os[i] = G->Xs[cycle[i]];
+  }
+}
+
+/**
+ * Stabilizes G at random Xs with stabilizations of random kinds until its
+ * arc index is n
+ * @param G a grid with room for n entries, grown in place
+ * @param n the arc index to reach
+ * @param seed the state of the generator
+ */
+static void stabilize_to(Grid_t *G, const int n, unsigned int *seed) {
+  while (G->arc_index < n) {
+    const int c = (int)(next_random(seed) % G->arc_index);
+    stabilize(G, c, (int)(next_random(seed) % 4));
+  }
+}
+
+/**
+ * Prints G as transverseHFK arguments
+ * @param G a grid
+ * @param args the options that add to the line
+ */
+static void print_grid(const Grid_t *const G, const struct arguments *args) {
+  printf("-i %d -X [", G->arc_index);
+  for (int i = 0; i < G->arc_index; ++i) {
+    printf((i > 0) ? ",%d" : "%d", G->Xs[i]);
+  }
+  printf("] -O [");
+  for (int i = 0; i < G->arc_index; ++i) {
+    printf((i > 0) ? ",%d" : "%d", G->Os[i]);
+  }
+  printf("]");
+  if (!args->simplify) {
+    printf(" -S");
+  }
+  if (args->sheets > 1) {
+    printf(" -n %d", args->sheets);
+  }
+  printf("\n");
+}
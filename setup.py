@@ -2,14 +2,17 @@ from distutils.core import setup, Extension
 import os
 
 include = ['./src']
-libs = []
+libs = ['pthread']
 lib_dirs = []
+macros = [(flag, None) for flag in ['HFK_PROFILE', 'HFK_TRACK_ALLOC']
+          if os.environ.get(flag)]
 
 _transverseHFK_module = Extension('transHFK._transHFK',
-                                  sources = ['./transHFK/_transverseHFKmodule.c', 'src/states.c', 'src/TransverseHFK.c'],
+                                  sources = ['./transHFK/_transverseHFKmodule.c', 'src/states.c', 'src/hashset.c', 'src/statetable.c', 'src/rectcache.c', 'src/scheduler.c', 'src/profile.c', 'src/alloctrack.c', 'src/TransverseHFK.c'],
                                   include_dirs = include,
                                   libraries = libs,
-                                  library_dirs = lib_dirs)
+                                  library_dirs = lib_dirs,
+                                  define_macros = macros)
 
 setup(name = '_transHFK',
       version = '1.0',
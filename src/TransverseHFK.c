@@ -17,12 +17,226 @@
 
 #include "TransverseHFK.h"
 
-printf_t print_ptr = printf;
-static int verbosity = SILENT;
-static LiftStateRBTree new_lift_rectangles_out_internal(const LiftStateRBTree,
-                                                        const LiftState,
-                                                        const LiftGrid_t *const,
-                                                        int);
+#define CHECKPOINT_MAGIC "HFKCKPT1"
+#define DELTA_MIN_KEY_LEN 16
+#define DELTA_MAX_DEPTH 4
+
+typedef void (*rectangle_fn)(const int, const int, void *);
+
+struct Candidates {
+  const Grid_t *G;
+  State incoming;
+  State temp_state;
+  StateRBTree prevs;
+  const StateTable_t *prev_table;
+  StateRBTree ans;
+  StateTable_t *toggled;
+  char *odd;
+  int odd_capacity;
+  int size;
+  long rectangles;
+  long cancelled;
+  long prev_hits;
+};
+
+struct LiftCandidates {
+  const LiftGrid_t *G;
+  LiftState incoming;
+  LiftStateRBTree prevs;
+  LiftStateRBTree ans;
+};
+
+struct Scratch {
+  struct Candidates cand;
+  State mirrored;
+  LiftState rows;
+  LiftState mirrored_rows;
+  EdgeList edges;
+  int edge_count;
+  long found;
+  long states;
+  unsigned short *pairs;
+  int pair_count;
+  int pair_capacity;
+  long cache_hits;
+  long cache_misses;
+};
+
+struct DeltaState {
+  int parent;
+  unsigned short i;
+  unsigned short j;
+};
+
+struct PackedLayer {
+  char *states;
+  struct DeltaState *deltas;
+  int *tags;
+  int count;
+  int key_len;
+  int depth;
+  int refs;
+  struct PackedLayer *parent;
+};
+
+struct Layer {
+  StateRBTree tree;
+  StateHashSet_t *set;
+  StateTable_t *table;
+  struct PackedLayer *packed;
+  int *parents;
+  int parent_capacity;
+  int order;
+};
+
+struct Complex {
+  const Grid_t *G;
+  const LiftGrid_t *L;
+  LiftGrid_t *L_mirror;
+  HFKContext_t *ctx;
+  RectangleCache_t *cache;
+  Grid_t K;
+  int print_before_merge;
+  int pipelined;
+  int cancel;
+  int compact;
+  int out_of_memory;
+  double memory_base;
+  int workers;
+  Scheduler_t *scheduler;
+  int owns_scheduler;
+  struct Scratch *scratch;
+};
+
+struct LayerReport {
+  char side;
+  int pos;
+  int present;
+  int states;
+  int edges;
+  long rectangles;
+  long cancelled;
+  long prev_hits;
+  double expand_seconds;
+  long edges_before;
+  long edges_after;
+  double contract_seconds;
+};
+
+struct Checkpoint {
+  unsigned long fingerprint;
+  int result;
+  int pos;
+  int num_ins;
+  int num_outs;
+  int edge_count;
+  struct timespec written;
+};
+
+struct Contraction {
+  struct Complex *C;
+  pthread_t thread;
+  EdgeList edge_list;
+  int prev_in_number;
+  int result;
+};
+
+struct ExpandTask {
+  struct Complex *C;
+  State *frontier;
+  int *tags;
+  StateRBTree *results;
+  const struct Layer *prevs;
+  struct Layer *dest;
+  int present_offset;
+  int dest_offset;
+  int into;
+};
+
+static void *default_alloc(void *, size_t);
+static void default_release(void *, void *);
+static void init_complex(struct Complex *, const Grid_t *const,
+                         const LiftGrid_t *const, const int, HFKContext_t *);
+static void free_complex(struct Complex *);
+static int null_homologous_complex(struct Complex *, StateRBTree, EdgeList);
+static int sentinel_status(const EdgeList, const int);
+static void *contract_layers(void *);
+static int is_cancelled(struct Complex *);
+static int reached_max_layers(const struct Complex *const, const int);
+static unsigned long complex_fingerprint(const struct Complex *,
+                                         const StateRBTree);
+static int checkpoint_due(const struct Complex *, const struct Checkpoint *);
+static void write_layer(FILE *, const struct Layer *, const HFKContext_t *const,
+                        const int);
+static int read_layer(FILE *, struct Layer *, const Grid_t *const);
+static void write_checkpoint(const struct Complex *, struct Checkpoint *,
+                             const struct Layer *, const struct Layer *,
+                             const EdgeList);
+static int read_checkpoint(const struct Complex *, struct Checkpoint *,
+                           struct Layer *, struct Layer *, EdgeList *);
+static void estimate_complex(struct Complex *, StateRBTree);
+static StateRBTree sample_layer(StateRBTree *, const int, const int,
+                               unsigned int *, const Grid_t *const);
+static int expand_layer(struct Complex *, const struct Layer *, const int,
+                        const struct Layer *, struct Layer *, const int,
+                        const int, EdgeList *, int *);
+static void find_candidates_task(const int, const int, void *);
+static void add_candidates_task(const int, const int, void *);
+static int collect_layer(const HFKContext_t *const, const struct Layer *,
+                         State **, int **);
+static int layer_is_empty(const struct Layer *);
+static int layer_size(const struct Layer *);
+static void print_layer_count(const struct Complex *, const char, const int,
+                              const struct Layer *, const int, const int,
+                              const struct Layer *const[4]);
+static int layer_contains(const struct Layer *, const State,
+                          const Grid_t *const);
+static void init_layer(struct Layer *, StateRBTree);
+static void free_layer(struct Layer *);
+static void release_packed(struct PackedLayer *);
+static void unpack_state(const struct PackedLayer *, const int, State);
+static void record_parent(struct Layer *, const int, const int);
+static int records_parents(const struct Complex *);
+static double layer_bytes(const struct Complex *, const struct Layer *);
+static double packed_bytes(const struct PackedLayer *);
+static double retained_bytes(const struct Layer *, const struct Layer *);
+static double cache_bytes(const struct Complex *);
+static void pack_layer(const struct Complex *, struct Layer *,
+                       const struct Layer *);
+static struct PackedLayer *delta_pack(const struct Complex *,
+                                      const struct Layer *,
+                                      const struct Layer *, State *, int *,
+                                      const int);
+static void sort_states(State *, int *, const int, const int);
+static int fit_memory(struct Complex *, struct Layer *, struct Layer *,
+                      struct Layer *, const long);
+static int over_memory(struct Complex *, const struct Layer *, const int);
+static long edge_list_length(const EdgeList);
+static void fill_report(const struct Complex *, struct LayerReport *,
+                        const char, const int, const int,
+                        const struct Layer *, const int,
+                        const struct timespec *);
+static void emit_report(const struct Complex *, const struct LayerReport *);
+static double seconds_since(const struct timespec *);
+static long resident_kb(void);
+static StateRBTree new_candidates(const struct Complex *, struct Scratch *,
+                                  const State, const StateRBTree, const int);
+static void add_candidates(const struct Complex *, struct Candidates *,
+                           const struct Layer *, const int, StateTable_t *,
+                           const int, const int, EdgeList *, int *);
+static void print_worker_stats(const struct Complex *);
+static void record_layer(struct Complex *, const int);
+static void rectangles_out_of_internal(const State, const Grid_t *const,
+                                       rectangle_fn, void *);
+static void rectangles_into_internal(const State, const Grid_t *const,
+                                     rectangle_fn, void *);
+static void toggle_candidate(const int, const int, void *);
+static void record_candidate(const int, const int, void *);
+static void lift_rectangles_internal(const LiftState, const LiftGrid_t *const,
+                                     const int, rectangle_fn, void *);
+static int lift_position(const int, const int, const LiftGrid_t *const,
+                         const int);
+static void toggle_lift_candidate(const int, const int, void *);
 static void advance_next_parent(EdgeList *, EdgeList *);
 static void sym_diff_parent(EdgeList *, EdgeList *, VertexList, EdgeList *);
 static void add_edge_in_place(const int, const int, EdgeList *, EdgeList *,
@@ -30,23 +244,148 @@ static void add_edge_in_place(const int, const int, EdgeList *, EdgeList *,
 static void remove_edge(EdgeList *, EdgeList *, EdgeList *);
 
 /**
- * Sets the print function to the passed in function pointer
- * @param print_fn a function pointer to a print function with the
- * same type as printf
+ * Fills ctx with the defaults: SILENT, printing to stdout, malloc and free,
+ * a single thread, no pipelining, no rectangle cache, zeroed statistics, no
+ * layer limit, no deadline, no estimate, a full calculation, no
+ * checkpoint, no memory budget and no telemetry.
+ * @param ctx the context to be initialized
+ */
+void init_context(HFKContext_t *ctx) {
+  ctx->verbosity = SILENT;
+  ctx->print = print_to_stream;
+  ctx->print_data = stdout;
+  ctx->alloc = default_alloc;
+  ctx->release = default_release;
+  ctx->alloc_data = NULL;
+  ctx->threads = 1;
+  ctx->pipelined = 0;
+  ctx->stats.layers = 0;
+  ctx->stats.states = 0;
+  ctx->stats.rectangles = 0;
+  ctx->stats.edges = 0;
+  ctx->stats.cache_hits = 0;
+  ctx->stats.cache_misses = 0;
+  ctx->rectangles = NULL;
+  ctx->scheduler = NULL;
+  ctx->cancel = 0;
+  ctx->max_layers = 0;
+  ctx->deadline.tv_sec = 0;
+  ctx->deadline.tv_nsec = 0;
+  ctx->estimate = NULL;
+  ctx->count_only = 0;
+  ctx->checkpoint = NULL;
+  ctx->checkpoint_interval = 0;
+  ctx->resume = 0;
+  ctx->max_memory = 0;
+  ctx->out_of_memory = 0;
+  ctx->telemetry = NULL;
+  ctx->label = "";
+}
+
+/**
+ * Asks the calculation running with ctx to stop. The calculation returns
+ * HFK_UNKNOWN once it notices. Safe to call from any thread.
+ * @param ctx a context
+ */
+void cancel_context(HFKContext_t *ctx) {
+  __atomic_store_n(&ctx->cancel, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Makes the calculation running with ctx stop once the supplied number of
+ * seconds from now have passed. The calculation returns HFK_UNKNOWN once it
+ * notices.
+ * @param ctx a context
+ * @param seconds the time the calculation is allowed to run
+ */
+void set_context_deadline(HFKContext_t *ctx, const double seconds) {
+  clock_gettime(CLOCK_MONOTONIC, &ctx->deadline);
+  ctx->deadline.tv_sec += (time_t)seconds;
+  ctx->deadline.tv_nsec += (long)((seconds - (time_t)seconds) * 1e9);
+  if (ctx->deadline.tv_nsec >= 1000000000L) {
+    ctx->deadline.tv_sec++;
+    ctx->deadline.tv_nsec -= 1000000000L;
+  }
+}
+
+/**
+ * @param ctx a context
+ * @return nonzero if cancel_context has been called on ctx or its deadline
+ * has passed
  */
-void set_print_fn(printf_t print_fn) { print_ptr = print_fn; }
+int is_context_cancelled(const HFKContext_t *const ctx) {
+  if (__atomic_load_n(&ctx->cancel, __ATOMIC_ACQUIRE)) {
+    return 1;
+  }
+  if (0 == ctx->deadline.tv_sec) {
+    return 0;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > ctx->deadline.tv_sec ||
+         (now.tv_sec == ctx->deadline.tv_sec &&
+          now.tv_nsec >= ctx->deadline.tv_nsec);
+}
 
 /**
- * Returns the current level of verbosity
- * @return the verbosity
+ * A sink for HFKContext_t that writes to a FILE
+ * @param data the FILE * to write to
+ * @param format a printf format string
+ * @param args the arguments of format
+ * @return the number of characters written
  */
-int get_verbosity() { return verbosity; }
+int print_to_stream(void *data, const char *format, va_list args) {
+  return vfprintf((FILE *)data, format, args);
+}
 
 /**
- * Set the level of verbosity to SILENT, QUIET, or VERBOSE
- * @param val the verbosity level
+ * Prints to the output sink of ctx
+ * @param ctx a context
+ * @param format a printf format string
+ * @return the number of characters written
  */
-void set_verbosity(const int val) { verbosity = val; }
+int hfk_printf(const HFKContext_t *const ctx, const char *format, ...) {
+  va_list args;
+  int ret;
+
+  va_start(args, format);
+  ret = (*ctx->print)(ctx->print_data, format, args);
+  va_end(args);
+
+  return ret;
+}
+
+/**
+ * Allocates memory with the allocator of ctx
+ * @param ctx a context
+ * @param size the number of bytes
+ * @return a pointer to the memory
+ */
+void *hfk_alloc(const HFKContext_t *const ctx, const size_t size) {
+  return (*ctx->alloc)(ctx->alloc_data, size);
+}
+
+/**
+ * Frees memory allocated by hfk_alloc
+ * @param ctx the context the memory was allocated with
+ * @param ptr the memory, may be NULL
+ */
+void hfk_free(const HFKContext_t *const ctx, void *ptr) {
+  if (NULL != ptr) {
+    (*ctx->release)(ctx->alloc_data, ptr);
+  }
+}
+
+static void *default_alloc(void *data, size_t size) {
+  (void)data;
+  return malloc(size);
+}
+
+static void default_release(void *data, void *ptr) {
+  (void)data;
+  free(ptr);
+}
 
 /**
  * Shifts the input towards the interval [0,arc_index) by
@@ -158,21 +497,15 @@ StateList swap_cols_list(const int x1, const int x2, const State incoming,
  * Calculates whether the supplied state is nullhomologous
  * @param init a State
  * @param G working grid
- * @return nonzero if nullhomologous and zero otherwise.
+ * @param ctx the context of the calculation
+ * @return 1 if nullhomologous, 0 if not and HFK_UNKNOWN if ctx was cancelled
+ * or its layer limit was reached
  */
-int null_homologous_D0Q(const State init, const Grid_t *const G) {
-  StateRBTree new_ins, new_outs;
-  StateRBTree prev_ins, prev_outs;
-  StateRBTree potential_outs = EMPTY_TREE, potential_ins = EMPTY_TREE;
-  int ans, prev_in_number, total_in, total_out;
-  int edge_count = 0;
-  int num_ins = 0;
-  int num_outs = 0;
-  int num_new_ins = 0;
-  int num_new_outs = 0;
-  prev_outs = EMPTY_TREE;
-  prev_ins = EMPTY_TREE;
-  new_ins = EMPTY_TREE;
+int null_homologous_D0Q(const State init, const Grid_t *const G,
+                       HFKContext_t *ctx) {
+  struct Complex C;
+  StateRBTree new_ins = EMPTY_TREE;
+  int ans;
 
   State s = malloc(sizeof(char) * G->arc_index);
   copy_state(&s, &init, G);
@@ -181,560 +514,2094 @@ int null_homologous_D0Q(const State init, const Grid_t *const G) {
   s_insert_tagged_data(&new_ins, s, 1, G);
   EdgeList edge_list = prepend_edge(0, 1, NULL);
 
-  ans = 0;
-  int current_pos = 1;
-  while (new_ins != EMPTY_TREE && !ans) {
-    num_new_outs = 0;
-    total_in = 0;
-    new_outs = EMPTY_TREE;
-    EdgeList new_edges = NULL;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering A_%d:\n", current_pos);
+  init_complex(&C, G, NULL, 0, ctx);
+  ans = null_homologous_complex(&C, new_ins, edge_list);
+  free_complex(&C);
+
+  return (ans);
+}
+
+/**
+ * Calculates if D1 of the supplied state is nullhomologous
+ * @param init a State
+ * @param G working grid
+ * @param ctx the context of the calculation
+ * @return 1 if nullhomologous, 0 if not and HFK_UNKNOWN if ctx was cancelled
+ * or its layer limit was reached
+ */
+int null_homologous_D1Q(const State init, const Grid_t *const G,
+                       HFKContext_t *ctx) {
+  struct Complex C;
+  StateRBTree new_ins = EMPTY_TREE;
+  EdgeList edge_list = NULL;
+  int ans;
+
+  // Calculate D1(init) and terminate if null. Otherwise build sentinal edges
+  // out of A_0
+  StateList d1_states = fixed_wt_rectangles_out_of(1, init, G);
+
+  if (NULL == d1_states) {
+    return 1;
+  }
+
+  int i = 0;
+  while (d1_states != NULL) {
+    StateList temp = d1_states;
+    i++;
+    edge_list = append_ordered(0, i, edge_list);
+    s_insert_tagged_data(&new_ins, d1_states->data, i, G);
+    d1_states = d1_states->nextState;
+    free(temp);
+  }
+
+  init_complex(&C, G, NULL, 1, ctx);
+  ans = null_homologous_complex(&C, new_ins, edge_list);
+  free_complex(&C);
+
+  return (ans);
+}
+
+/**
+ * Calculates whether the supplied lift state is nullhomologous
+ * @param init a LiftState
+ * @param G working lift grid
+ * @param ctx the context of the calculation
+ * @return 1 if nullhomologous, 0 if not and HFK_UNKNOWN if ctx was cancelled
+ * or its layer limit was reached
+ */
+int null_homologous_lift(const LiftState init, const LiftGrid_t *const G,
+                         HFKContext_t *ctx) {
+  struct Complex C;
+  StateRBTree new_ins = EMPTY_TREE;
+  int ans;
+
+  init_complex(&C, NULL, G, 0, ctx);
+
+  State s = malloc(sizeof(char) * C.K.arc_index);
+  for (int i = 0; i < G->sheets; ++i) {
+    memcpy(&s[i * G->arc_index], init[i], G->arc_index);
+  }
+
+  // Create sentinal edge from A_0
+  s_insert_tagged_data(&new_ins, s, 1, &C.K);
+  EdgeList edge_list = prepend_edge(0, 1, NULL);
+
+  ans = null_homologous_complex(&C, new_ins, edge_list);
+  free_complex(&C);
+
+  return (ans);
+}
+
+/**
+ * Prepares C for calculating the complex of either the grid G or the lift
+ * grid L. Lift states are stored flattened sheet by sheet so that both cases
+ * share the same trees; the key grid C->K describes these flattened states.
+ * @param C the complex to be initialized
+ * @param G working grid, or NULL when L is supplied
+ * @param L working lift grid, or NULL when G is supplied
+ * @param print_before_merge nonzero to print the full edge list before the
+ * new edges are merged into it
+ * @param ctx the context of the calculation
+ */
+static void init_complex(struct Complex *C, const Grid_t *const G,
+                         const LiftGrid_t *const L,
+                         const int print_before_merge, HFKContext_t *ctx) {
+  C->ctx = ctx;
+  C->G = G;
+  C->L = L;
+  C->L_mirror = NULL;
+  C->K.Xs = NULL;
+  C->K.Os = NULL;
+  C->print_before_merge = print_before_merge;
+  C->pipelined =
+      ctx->pipelined && ctx->verbosity < VERBOSE && NULL == ctx->checkpoint;
+  C->cancel = 0;
+  C->compact = 0;
+  C->out_of_memory = 0;
+  C->memory_base = 0;
+  C->workers = (ctx->threads < 1) ? 1 : ctx->threads;
+
+  if (NULL == L) {
+    C->K.arc_index = G->arc_index;
+  } else {
+    C->K.arc_index = L->sheets * L->arc_index;
+    C->L_mirror = mirror_lift_grid(L);
+  }
+
+  // A cache is only valid for the grid it was filled from. Lifts are never
+  // cached, as their states are longer than those of any grid.
+  C->cache = ctx->rectangles;
+  if (NULL != C->cache && (NULL != L || !rectangle_cache_fits(C->cache, G))) {
+    C->cache = NULL;
+  }
+
+  C->scratch = hfk_alloc(ctx, sizeof(struct Scratch) * C->workers);
+  for (int i = 0; i < C->workers; ++i) {
+    struct Scratch *S = &C->scratch[i];
+    S->cand.G = &C->K;
+    S->cand.temp_state = hfk_alloc(ctx, sizeof(char) * C->K.arc_index);
+    S->cand.prev_table = NULL;
+    S->cand.toggled = NULL;
+    S->cand.odd = NULL;
+    S->cand.odd_capacity = 0;
+    S->cand.rectangles = 0;
+    S->cand.cancelled = 0;
+    S->cand.prev_hits = 0;
+    S->states = 0;
+    S->pairs = NULL;
+    S->pair_count = 0;
+    S->pair_capacity = 0;
+    S->mirrored = NULL;
+    S->rows = NULL;
+    S->mirrored_rows = NULL;
+    if (NULL != L) {
+      S->mirrored = hfk_alloc(ctx, sizeof(char) * C->K.arc_index);
+      S->rows = hfk_alloc(ctx, sizeof(char *) * L->sheets);
+      S->mirrored_rows = hfk_alloc(ctx, sizeof(char *) * L->sheets);
+      for (int j = 0; j < L->sheets; ++j) {
+        S->mirrored_rows[j] = &S->mirrored[j * L->arc_index];
+      }
     }
+  }
 
-    // Build A_i by looking for states into B_(i-1) that are not in A_(i-1)
-    StateTreeIter_t *present_iter;
-    for (present_iter = s_create_iter(new_ins); s_has_next(present_iter);) {
-      StateRBTree present_in = s_get_next(present_iter);
-      total_in++;
-      potential_outs = new_rectangles_into(prev_outs, present_in->data, G);
-
-      StateTreeIter_t *potential_iter;
-      for (potential_iter = s_create_iter(potential_outs);
-           s_has_next(potential_iter);) {
-        StateRBTree potential_out = s_get_next(potential_iter);
-        StateRBTree node = s_find_node(&new_outs, potential_out->data, G);
-        if (EMPTY_TREE == node) {
-          State t = malloc(sizeof(char) * G->arc_index);
-          copy_state(&t, &(potential_out->data), G);
-          num_new_outs++;
-          s_insert_tagged_data(&new_outs, t, num_new_outs, G);
-          new_edges = prepend_edge(num_new_outs + num_outs,
-                                   present_in->tag + num_ins, new_edges);
-        } else {
-          new_edges = prepend_edge(node->tag + num_outs,
-                                   present_in->tag + num_ins, new_edges);
+  // Reuse the scheduler of the context when it has the right number of
+  // workers rather than starting new threads for every calculation
+  C->scheduler = NULL;
+  C->owns_scheduler = 0;
+  if (C->workers > 1) {
+    if (NULL != ctx->scheduler && ctx->scheduler->workers == C->workers) {
+      C->scheduler = ctx->scheduler;
+    } else {
+      C->scheduler = create_scheduler(C->workers);
+      C->owns_scheduler = 1;
+    }
+  }
+}
+
+/**
+ * Frees the memory allocated by init_complex
+ * @param C a complex
+ */
+static void free_complex(struct Complex *C) {
+  if (C->owns_scheduler) {
+    free_scheduler(C->scheduler);
+  }
+  for (int i = 0; i < C->workers; ++i) {
+    hfk_free(C->ctx, C->scratch[i].cand.temp_state);
+    hfk_free(C->ctx, C->scratch[i].mirrored);
+    hfk_free(C->ctx, C->scratch[i].rows);
+    hfk_free(C->ctx, C->scratch[i].mirrored_rows);
+    free(C->scratch[i].pairs);
+    free(C->scratch[i].cand.odd);
+  }
+  hfk_free(C->ctx, C->scratch);
+  if (NULL != C->L_mirror) {
+    free(C->L_mirror->Xs);
+    free(C->L_mirror->Os);
+    free(C->L_mirror);
+  }
+}
+
+/**
+ * Builds the layers A_1, B_1, A_2, ... of the complex starting from B_0 and
+ * contracts the edges after each pair of layers until the edges out of the
+ * sentinal A_0 either vanish or can no longer be removed.
+ * @param C a complex prepared by init_complex
+ * @param init B_0, whose tags start at 1. Freed by this function
+ * @param edge_list the edges from A_0 into B_0. Freed by this function
+ * @return 1 if nullhomologous, 0 if not and HFK_UNKNOWN if the context was
+ * cancelled or its layer limit was reached
+ * @note with a checkpoint file in the context the calculation is written to
+ * it between layers, and with resume it carries on from the file
+ */
+static int null_homologous_complex(struct Complex *C, StateRBTree init,
+                                   EdgeList edge_list) {
+  struct Layer new_ins, new_outs, prev_ins, prev_outs;
+  int ans, prev_in_number, total_in, total_out;
+  int edge_count = 0;
+  int num_ins = 0;
+  int num_outs = 0;
+  int current_pos = 1;
+  long live_edges;
+  struct timespec phase;
+  struct LayerReport report;
+  struct Contraction contraction;
+  struct Checkpoint ckpt;
+  int pending = 0;
+
+  init_layer(&new_ins, init);
+  init_layer(&new_outs, EMPTY_TREE);
+  init_layer(&prev_ins, EMPTY_TREE);
+  init_layer(&prev_outs, EMPTY_TREE);
+  if (NULL != C->ctx->estimate) {
+    free_edge_list(edge_list);
+    estimate_complex(C, init);
+    return HFK_UNKNOWN;
+  }
+
+  if (C->ctx->count_only) {
+    const struct Layer *const live[4] = {&prev_ins, &prev_outs, &new_ins,
+                                         &new_outs};
+    edge_count = layer_size(&new_ins);
+    print_layer_count(C, 'B', 0, &new_ins, edge_count, edge_count, live);
+    free_edge_list(edge_list);
+    edge_list = NULL;
+  }
+
+  if (NULL != C->ctx->checkpoint && !C->ctx->count_only) {
+    ckpt.fingerprint = complex_fingerprint(C, new_ins.tree);
+    ckpt.result = HFK_UNKNOWN;
+    clock_gettime(CLOCK_MONOTONIC, &ckpt.written);
+    if (C->ctx->resume) {
+      struct Layer ins, outs;
+      EdgeList edges = NULL;
+      if (read_checkpoint(C, &ckpt, &ins, &outs, &edges)) {
+        free_layer(&new_ins);
+        free_edge_list(edge_list);
+        if (ckpt.result >= 0) {
+          return ckpt.result;
+        }
+        new_ins = ins;
+        prev_outs = outs;
+        edge_list = edges;
+        current_pos = ckpt.pos;
+        // A_(i-1) and B_(i-1) sit at 2i - 3 and 2i - 2 in the order B_0,
+        // A_1, B_1, ... the layers are built in
+        prev_outs.order = 2 * current_pos - 3;
+        new_ins.order = 2 * current_pos - 2;
+        num_ins = ckpt.num_ins;
+        num_outs = ckpt.num_outs;
+        edge_count = ckpt.edge_count;
+        if (C->ctx->verbosity >= VERBOSE) {
+          hfk_printf(C->ctx, "Resuming at A_%d from %s\n", current_pos,
+                     C->ctx->checkpoint);
         }
-        edge_count++;
       }
+    }
+  }
 
-      free_state_rbtree(&potential_outs);
-      s_free_iter(potential_iter);
+  contraction.C = C;
+  ans = 0;
+  live_edges = edge_list_length(edge_list);
+  while (!layer_is_empty(&new_ins)) {
+    EdgeList new_edges = NULL;
+    const int first_edge = edge_count;
+    // B_(i-2) is not needed to build A_i, so it goes first when memory is
+    // short
+    if (fit_memory(C, &prev_ins, &new_ins, &prev_outs, live_edges)) {
+      ans = HFK_UNKNOWN;
+      break;
+    }
+    if (C->ctx->verbosity >= VERBOSE) {
+      hfk_printf(C->ctx, "Gathering A_%d:\n", current_pos);
+    }
+
+    // Build A_i by looking for states into B_(i-1) that are not in A_(i-1)
+    int layer_edges = edge_count;
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+    total_in = expand_layer(C, &new_ins, num_ins, &prev_outs, &new_outs,
+                            num_outs, 1, &new_edges, &edge_count);
+    record_layer(C, total_in);
+    fill_report(C, &report, 'A', current_pos, total_in, &new_outs,
+                edge_count - layer_edges, &phase);
+    emit_report(C, &report);
+    if (C->ctx->count_only) {
+      const struct Layer *const live[4] = {&prev_ins, &prev_outs, &new_ins,
+                                           &new_outs};
+      print_layer_count(C, 'A', current_pos, &new_outs,
+                        edge_count - layer_edges, edge_count, live);
     }
-    s_free_iter(present_iter);
 
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
+    if (C->ctx->verbosity >= VERBOSE) {
+      print_edges(C->ctx, new_edges);
+      hfk_printf(C->ctx, "\n");
+      print_worker_stats(C);
     }
-    free_state_rbtree(&prev_ins);
+    free_layer(&prev_ins);
     prev_ins = new_ins;
     num_ins = num_ins + total_in;
     prev_in_number = num_ins;
-    num_new_ins = 0;
-    new_ins = EMPTY_TREE;
-    total_out = 0;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering B_%d:\n", current_pos);
+    init_layer(&new_ins, EMPTY_TREE);
+    if (!C->ctx->count_only) {
+      live_edges += edge_count - layer_edges;
+    }
+    if (C->out_of_memory ||
+        fit_memory(C, &prev_outs, &prev_ins, &new_outs, live_edges)) {
+      free_edge_list(new_edges);
+      ans = HFK_UNKNOWN;
+      break;
+    }
+    if (C->ctx->verbosity >= VERBOSE) {
+      hfk_printf(C->ctx, "Gathering B_%d:\n", current_pos);
     }
 
     // Build B_i by finding states out of A_i that are not in B_(i-1)
-    for (present_iter = s_create_iter(new_outs); s_has_next(present_iter);) {
-      StateRBTree present_out = s_get_next(present_iter);
-      total_out++;
-      potential_ins = new_rectangles_out_of(prev_ins, present_out->data, G);
-
-      StateTreeIter_t *potential_iter;
-      for (potential_iter = s_create_iter(potential_ins);
-           s_has_next(potential_iter);) {
-        StateRBTree potential_in = s_get_next(potential_iter);
-        StateRBTree node = s_find_node(&new_ins, potential_in->data, G);
-        if (EMPTY_TREE == node) {
-          State t = malloc(sizeof(char) * G->arc_index);
-          copy_state(&t, &(potential_in->data), G);
-          num_new_ins++;
-          s_insert_tagged_data(&new_ins, t, num_new_ins, G);
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   num_new_ins + num_ins, new_edges);
-        } else {
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   node->tag + num_ins, new_edges);
-        }
-        edge_count++;
+    layer_edges = edge_count;
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+    total_out = expand_layer(C, &new_outs, num_outs, &prev_ins, &new_ins,
+                             num_ins, 0, &new_edges, &edge_count);
+    record_layer(C, total_out);
+    fill_report(C, &report, 'B', current_pos, total_out, &new_ins,
+                edge_count - layer_edges, &phase);
+    if (C->ctx->count_only) {
+      const struct Layer *const live[4] = {&prev_ins, &prev_outs, &new_ins,
+                                           &new_outs};
+      print_layer_count(C, 'B', current_pos, &new_ins,
+                        edge_count - layer_edges, edge_count, live);
+    }
+
+    if (C->ctx->verbosity >= VERBOSE) {
+      print_edges(C->ctx, new_edges);
+      hfk_printf(C->ctx, "\n");
+      print_worker_stats(C);
+    }
+    free_layer(&prev_outs);
+    prev_outs = new_outs;
+    init_layer(&new_outs, EMPTY_TREE);
+    if (!C->ctx->count_only) {
+      live_edges += edge_count - layer_edges;
+    }
+
+    if (is_context_cancelled(C->ctx) || C->out_of_memory) {
+      emit_report(C, &report);
+      free_edge_list(new_edges);
+      ans = HFK_UNKNOWN;
+      break;
+    }
+
+    if (C->ctx->count_only || C->pipelined) {
+      // B_i is contracted later, if at all
+      emit_report(C, &report);
+    }
+
+    if (C->ctx->count_only) {
+      num_outs = num_outs + total_out;
+      ans = HFK_UNKNOWN;
+      if (reached_max_layers(C, current_pos)) {
+        C->ctx->stats.states += layer_size(&new_ins);
+        break;
       }
+      current_pos++;
+      continue;
+    }
 
-      free_state_rbtree(&potential_ins);
-      s_free_iter(potential_iter);
+    if (C->pipelined) {
+      // Contract up to B_(i-1) on its own thread while A_(i+1) and B_(i+1)
+      // are built. The layers do not depend on the contraction, so they are
+      // only thrown away if the previous contraction already decided.
+      num_outs = num_outs + total_out;
+      PROFILE_START(sort_start);
+      new_edges = merge_sort_edges(new_edges);
+      PROFILE_STOP(PROFILE_SORT_EDGES, sort_start);
+      if (pending) {
+        pthread_join(contraction.thread, NULL);
+        pending = 0;
+        edge_list = contraction.edge_list;
+        live_edges = edge_list_length(edge_list) + edge_count - first_edge;
+        if (contraction.result >= 0) {
+          ans = contraction.result;
+          free_edge_list(new_edges);
+          break;
+        }
+      }
+      contraction.edge_list = merge_edges(edge_list, new_edges);
+      contraction.prev_in_number = prev_in_number;
+      edge_list = NULL;
+      pthread_create(&contraction.thread, NULL, contract_layers, &contraction);
+      pending = 1;
+      if (reached_max_layers(C, current_pos)) {
+        // Unless the contraction just started decides
+        ans = HFK_UNKNOWN;
+        break;
+      }
+      current_pos++;
+      continue;
     }
-    s_free_iter(present_iter);
 
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
+    if (C->print_before_merge && C->ctx->verbosity >= VERBOSE) {
+      hfk_printf(C->ctx, "Full edge list:\n");
+      print_edges(C->ctx, edge_list);
+      hfk_printf(C->ctx, "\n");
+      hfk_printf(C->ctx, "Contracting edges from 0 to %d:\n",
+                 prev_in_number);
     }
-    free_state_rbtree(&prev_outs);
-    prev_outs = new_outs;
-    new_outs = EMPTY_TREE;
 
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+    report.edges_before = live_edges;
+    PROFILE_START(sort_start);
     new_edges = merge_sort_edges(new_edges);
+    PROFILE_STOP(PROFILE_SORT_EDGES, sort_start);
     edge_list = merge_edges(edge_list, new_edges);
 
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Full edge list:\n");
-      print_edges(edge_list);
-      (*print_ptr)("\n");
-      (*print_ptr)("Contracting edges from 0 to %d:\n", prev_in_number);
+    if (!C->print_before_merge && C->ctx->verbosity >= VERBOSE) {
+      hfk_printf(C->ctx, "Full edge list:\n");
+      print_edges(C->ctx, edge_list);
+      hfk_printf(C->ctx, "\n");
+      hfk_printf(C->ctx, "Contracting edges from 0 to %d:\n",
+                 prev_in_number);
     }
 
-    special_homology(0, prev_in_number, &edge_list);
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(edge_list);
-      (*print_ptr)("\n");
+    if (HFK_UNKNOWN ==
+        special_homology(0, prev_in_number, &edge_list, C->ctx)) {
+      emit_report(C, &report);
+      ans = HFK_UNKNOWN;
+      break;
+    }
+    if (C->ctx->verbosity >= VERBOSE) {
+      print_edges(C->ctx, edge_list);
+      hfk_printf(C->ctx, "\n");
     }
 
-    if ((edge_list == NULL) || (edge_list->start != 0)) {
+    live_edges = edge_list_length(edge_list);
+    report.edges_after = live_edges;
+    report.contract_seconds = seconds_since(&phase);
+    emit_report(C, &report);
+    const int status = sentinel_status(edge_list, prev_in_number);
+    if (1 == status) {
       // If there are no edges out of A_0 (sentinal is gone) after contraction
       // init is null-homologous
       ans = 1;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("No edges pointing out of A_0!\n");
+      if (C->ctx->verbosity >= VERBOSE) {
+        hfk_printf(C->ctx, "No edges pointing out of A_0!\n");
       }
-      free_state_rbtree(&new_ins);
-      free_state_rbtree(&new_outs);
-      free_state_rbtree(&prev_ins);
-      free_state_rbtree(&prev_outs);
-    } else if (edge_list->end <= prev_in_number) {
+      break;
+    } else if (0 == status) {
       // If edges out of A_0 cannot be removed anymore (sentinal will never
       // vanish) init is not null-homologous
       ans = 0;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("There exist edges pointing from A_0 to B_%d! No future "
-                     "contractions will remove this edge!\n",
-                     current_pos - 1);
+      if (C->ctx->verbosity >= VERBOSE) {
+        hfk_printf(C->ctx,
+                   "There exist edges pointing from A_0 to B_%d! No future "
+                   "contractions will remove this edge!\n",
+                   current_pos - 1);
       }
-      free_state_rbtree(&new_ins);
-      free_state_rbtree(&new_outs);
-      free_state_rbtree(&prev_ins);
-      free_state_rbtree(&prev_outs);
+      break;
     } else {
       num_outs = num_outs + total_out;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos - 1, prev_in_number);
-        (*print_ptr)("Total number of states in A_i up to A_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_outs);
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_ins + total_in);
-        (*print_ptr)("Total number of edges  up to A_%d and B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, current_pos, edge_count);
-        (*print_ptr)("\n");
+      if (C->ctx->verbosity >= VERBOSE) {
+        hfk_printf(C->ctx,
+                   "Total number of states in B_i up to B_%d (before any "
+                   "contraction): %d \n",
+                   current_pos - 1, prev_in_number);
+        hfk_printf(C->ctx,
+                   "Total number of states in A_i up to A_%d (before any "
+                   "contraction): %d \n",
+                   current_pos, num_outs);
+        hfk_printf(C->ctx,
+                   "Total number of states in B_i up to B_%d (before any "
+                   "contraction): %d \n",
+                   current_pos, num_ins + total_in);
+        hfk_printf(C->ctx,
+                   "Total number of edges  up to A_%d and B_%d (before any "
+                   "contraction): %d \n",
+                   current_pos, current_pos, edge_count);
+        hfk_printf(C->ctx, "\n");
       }
     }
+    if (NULL != C->ctx->checkpoint && checkpoint_due(C, &ckpt)) {
+      // The layers and counters are those the next iteration starts from
+      ckpt.pos = current_pos + 1;
+      ckpt.num_ins = num_ins;
+      ckpt.num_outs = num_outs;
+      ckpt.edge_count = edge_count;
+      write_checkpoint(C, &ckpt, &new_ins, &prev_outs, edge_list);
+    }
+    if (reached_max_layers(C, current_pos)) {
+      ans = HFK_UNKNOWN;
+      break;
+    }
     current_pos++;
   }
 
+  if (NULL != C->ctx->checkpoint && !C->ctx->count_only && ans >= 0) {
+    ckpt.result = ans;
+    write_checkpoint(C, &ckpt, NULL, NULL, NULL);
+  }
+
+  if (pending) {
+    pthread_join(contraction.thread, NULL);
+    edge_list = contraction.edge_list;
+    if (contraction.result >= 0) {
+      ans = contraction.result;
+    }
+  }
+
+  C->ctx->stats.edges += edge_count;
+  free_layer(&new_ins);
+  free_layer(&new_outs);
+  free_layer(&prev_ins);
+  free_layer(&prev_outs);
   free_edge_list(edge_list);
   return (ans);
 }
 
 /**
- * Calculates if D1 of the supplied state is nullhomologous
- * @param init a State
- * @param G working grid
- * @return nonzero if nullhomologous and zero otherwise
+ * Checks the edges out of the sentinal A_0 after contracting the edges from
+ * 0 to prev_in_number.
+ * @param edge_list a sorted EdgeList
+ * @param prev_in_number the number of states in B_0 through B_(i-1)
+ * @return 1 if there are no edges out of A_0, 0 if an edge out of A_0 can no
+ * longer be removed, and -1 if the next layers are needed to decide
  */
-int null_homologous_D1Q(const State init, const Grid_t *const G) {
-  StateRBTree new_ins, new_outs;
-  StateRBTree prev_ins, prev_outs;
-  StateRBTree potential_outs = EMPTY_TREE, potential_ins = EMPTY_TREE;
-  int ans, prev_in_number, total_in, total_out;
-  int edge_count = 0;
-  int num_ins = 0;
-  int num_outs = 0;
-  int num_new_ins = 0;
-  int num_new_outs = 0;
-  EdgeList edge_list;
-  prev_outs = EMPTY_TREE;
-  prev_ins = EMPTY_TREE;
-  new_ins = EMPTY_TREE;
+static int sentinel_status(const EdgeList edge_list, const int prev_in_number) {
+  if ((edge_list == NULL) || (edge_list->start != 0)) {
+    return 1;
+  } else if (edge_list->end <= prev_in_number) {
+    return 0;
+  }
+  return -1;
+}
 
-  // Calculate D1(init) and terminate if null. Otherwise build sentinal edges
-  // out of A_0
-  StateList d1_states = fixed_wt_rectangles_out_of(1, init, G);
+/**
+ * Thread body of a pipelined contraction. Once the sentinal is decided the
+ * layers being built are cancelled.
+ * @param arg a struct Contraction
+ */
+static void *contract_layers(void *arg) {
+  struct Contraction *contraction = arg;
+  if (HFK_UNKNOWN == special_homology(0, contraction->prev_in_number,
+                                      &contraction->edge_list,
+                                      contraction->C->ctx)) {
+    // The context was cancelled, which the main loop notices on its own
+    contraction->result = -1;
+    return NULL;
+  }
+  contraction->result =
+      sentinel_status(contraction->edge_list, contraction->prev_in_number);
+  if (contraction->result >= 0) {
+    __atomic_store_n(&contraction->C->cancel, 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
 
-  if (NULL == d1_states) {
+/**
+ * @param C a complex
+ * @return nonzero if a pipelined contraction has decided the sentinal or the
+ * context was cancelled, so the layer being built is no longer needed
+ */
+static int is_cancelled(struct Complex *C) {
+  return __atomic_load_n(&C->cancel, __ATOMIC_ACQUIRE) ||
+         is_context_cancelled(C->ctx);
+}
+
+/**
+ * @param C a complex
+ * @param pos the index i of the layers A_i and B_i just built
+ * @return nonzero if the context limits the calculation to pos layers
+ */
+static int reached_max_layers(const struct Complex *const C, const int pos) {
+  return C->ctx->max_layers > 0 && pos >= C->ctx->max_layers;
+}
+
+/**
+ * Fingerprints a complex so that a checkpoint is only resumed by the
+ * calculation that wrote it
+ * @param C a complex prepared by init_complex
+ * @param init B_0
+ * @return a hash of the grid, the kind of complex and the states of B_0
+ */
+static unsigned long complex_fingerprint(const struct Complex *C,
+                                         const StateRBTree init) {
+  const State Xs = (NULL == C->L) ? C->G->Xs : C->L->Xs;
+  const State Os = (NULL == C->L) ? C->G->Os : C->L->Os;
+  const int arc_index = (NULL == C->L) ? C->G->arc_index : C->L->arc_index;
+  const int header[3] = {arc_index, (NULL == C->L) ? 1 : C->L->sheets,
+                         C->print_before_merge};
+  unsigned long h = hash_state((const State)header, sizeof(header));
+  StateTreeIter_t *iter;
+
+  h = h * 1099511628211UL ^ hash_state(Xs, arc_index);
+  h = h * 1099511628211UL ^ hash_state(Os, arc_index);
+  for (iter = s_create_iter(init); s_has_next(iter);) {
+    StateRBTree node = s_get_next(iter);
+    h = h * 1099511628211UL ^ hash_state(node->data, C->K.arc_index);
+    h = h * 1099511628211UL ^ (unsigned long)node->tag;
+  }
+  s_free_iter(iter);
+  return h;
+}
+
+/**
+ * @param C a complex
+ * @param ckpt the checkpoint of the calculation
+ * @return nonzero if checkpoint_interval seconds have passed since ckpt was
+ * last written
+ */
+static int checkpoint_due(const struct Complex *C,
+                          const struct Checkpoint *ckpt) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - ckpt->written.tv_sec) +
+             (now.tv_nsec - ckpt->written.tv_nsec) / 1e9 >=
+         C->ctx->checkpoint_interval;
+}
+
+/**
+ * Writes the states and tags of a layer to a checkpoint file
+ * @param file the file
+ * @param layer a layer
+ * @param ctx the context of the calculation
+ * @param key_len the length of a state
+ */
+static void write_layer(FILE *file, const struct Layer *layer,
+                        const HFKContext_t *const ctx, const int key_len) {
+  State *states;
+  int *tags;
+  const int count = collect_layer(ctx, layer, &states, &tags);
+
+  fwrite(&count, sizeof(int), 1, file);
+  for (int i = 0; i < count; ++i) {
+    fwrite(&tags[i], sizeof(int), 1, file);
+    fwrite(states[i], sizeof(char), key_len, file);
+  }
+  hfk_free(ctx, states);
+  hfk_free(ctx, tags);
+}
+
+/**
+ * Reads a layer written by write_layer into a tree
+ * @param file the file
+ * @param layer destination for the layer, empty on failure
+ * @param K the grid describing the states of the layer
+ * @return 1 if the layer was read, 0 if the file is truncated
+ */
+static int read_layer(FILE *file, struct Layer *layer, const Grid_t *const K) {
+  int count, tag;
+
+  init_layer(layer, EMPTY_TREE);
+  if (1 != fread(&count, sizeof(int), 1, file)) {
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    State s = malloc(sizeof(char) * K->arc_index);
+    if (1 != fread(&tag, sizeof(int), 1, file) ||
+        K->arc_index != (int)fread(s, sizeof(char), K->arc_index, file)) {
+      free(s);
+      free_layer(layer);
+      return 0;
+    }
+    s_insert_tagged_data(&layer->tree, s, tag, K);
+  }
+  return 1;
+}
+
+/**
+ * Writes the checkpoint of a calculation to the checkpoint file of its
+ * context. The file holds CHECKPOINT_MAGIC, the length of a state, the
+ * fingerprint of the complex and its result. A calculation that is still
+ * undecided follows the result with the position, the counters, the layers
+ * B_(pos-1) and A_(pos-1) as a count followed by a tag and the bytes of each
+ * state, and the contracted edges as a count followed by their ends. The
+ * checkpoint is written next to the file and renamed over it so that an
+ * interrupted write leaves the last checkpoint in place.
+ * @param C a complex
+ * @param ckpt the checkpoint, whose time written is updated
+ * @param ins B_(pos-1), or NULL once the result is known
+ * @param outs A_(pos-1), or NULL once the result is known
+ * @param edge_list the edges contracted up to B_(pos-2)
+ */
+static void write_checkpoint(const struct Complex *C, struct Checkpoint *ckpt,
+                             const struct Layer *ins,
+                             const struct Layer *outs,
+                             const EdgeList edge_list) {
+  const char *path = C->ctx->checkpoint;
+  char *tmp = malloc(sizeof(char) * (strlen(path) + 5));
+  FILE *file;
+
+  sprintf(tmp, "%s.tmp", path);
+  file = fopen(tmp, "wb");
+  if (NULL == file) {
+    hfk_printf(C->ctx, "Cannot write the checkpoint %s\n", tmp);
+    free(tmp);
+    return;
+  }
+
+  fwrite(CHECKPOINT_MAGIC, sizeof(char), strlen(CHECKPOINT_MAGIC), file);
+  fwrite(&C->K.arc_index, sizeof(int), 1, file);
+  fwrite(&ckpt->fingerprint, sizeof(unsigned long), 1, file);
+  fwrite(&ckpt->result, sizeof(int), 1, file);
+  if (ckpt->result < 0) {
+    int count = 0;
+    fwrite(&ckpt->pos, sizeof(int), 1, file);
+    fwrite(&ckpt->num_ins, sizeof(int), 1, file);
+    fwrite(&ckpt->num_outs, sizeof(int), 1, file);
+    fwrite(&ckpt->edge_count, sizeof(int), 1, file);
+    write_layer(file, ins, C->ctx, C->K.arc_index);
+    write_layer(file, outs, C->ctx, C->K.arc_index);
+    for (EdgeList e = edge_list; NULL != e; e = e->nextEdge) {
+      count++;
+    }
+    fwrite(&count, sizeof(int), 1, file);
+    for (EdgeList e = edge_list; NULL != e; e = e->nextEdge) {
+      fwrite(&e->start, sizeof(int), 1, file);
+      fwrite(&e->end, sizeof(int), 1, file);
+    }
+  }
+
+  if (0 != fclose(file) || 0 != rename(tmp, path)) {
+    hfk_printf(C->ctx, "Cannot write the checkpoint %s\n", path);
+    remove(tmp);
+  }
+  free(tmp);
+  clock_gettime(CLOCK_MONOTONIC, &ckpt->written);
+}
+
+/**
+ * Reads the checkpoint file of the context of a calculation
+ * @param C a complex
+ * @param ckpt the checkpoint, whose fingerprint is that of the calculation.
+ * Filled with the result, position and counters read
+ * @param ins destination for B_(pos-1)
+ * @param outs destination for A_(pos-1)
+ * @param edge_list destination for the contracted edges
+ * @return 1 if the file holds a checkpoint of the calculation, in which case
+ * ins, outs and edge_list are only filled when its result is unknown, and 0
+ * otherwise
+ */
+static int read_checkpoint(const struct Complex *C, struct Checkpoint *ckpt,
+                           struct Layer *ins, struct Layer *outs,
+                           EdgeList *edge_list) {
+  FILE *file = fopen(C->ctx->checkpoint, "rb");
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  const size_t magic_len = strlen(CHECKPOINT_MAGIC);
+  unsigned long fingerprint;
+  int key_len, count, ok;
+
+  if (NULL == file) {
+    return 0;
+  }
+
+  ok = magic_len == fread(magic, sizeof(char), magic_len, file) &&
+       0 == memcmp(magic, CHECKPOINT_MAGIC, magic_len) &&
+       1 == fread(&key_len, sizeof(int), 1, file) &&
+       key_len == C->K.arc_index &&
+       1 == fread(&fingerprint, sizeof(unsigned long), 1, file) &&
+       fingerprint == ckpt->fingerprint &&
+       1 == fread(&ckpt->result, sizeof(int), 1, file);
+  if (ok && ckpt->result < 0) {
+    init_layer(ins, EMPTY_TREE);
+    init_layer(outs, EMPTY_TREE);
+    ok = 1 == fread(&ckpt->pos, sizeof(int), 1, file) &&
+         1 == fread(&ckpt->num_ins, sizeof(int), 1, file) &&
+         1 == fread(&ckpt->num_outs, sizeof(int), 1, file) &&
+         1 == fread(&ckpt->edge_count, sizeof(int), 1, file) &&
+         read_layer(file, ins, &C->K);
+    ok = ok && read_layer(file, outs, &C->K);
+    ok = ok && 1 == fread(&count, sizeof(int), 1, file);
+
+    // The edges were written in order, so they are appended in order
+    EdgeList *tail = edge_list;
+    *edge_list = NULL;
+    for (int i = 0; ok && i < count; ++i) {
+      EdgeList e = malloc(sizeof(EdgeNode_t));
+      e->nextEdge = NULL;
+      *tail = e;
+      tail = &e->nextEdge;
+      ok = 1 == fread(&e->start, sizeof(int), 1, file) &&
+           1 == fread(&e->end, sizeof(int), 1, file);
+    }
+    if (!ok) {
+      free_layer(ins);
+      free_layer(outs);
+      free_edge_list(*edge_list);
+      *edge_list = NULL;
+    }
+  }
+  fclose(file);
+
+  if (!ok) {
+    hfk_printf(C->ctx,
+               "Ignoring the checkpoint %s, which is not of this "
+               "calculation\n",
+               C->ctx->checkpoint);
+  }
+  return ok;
+}
+
+/**
+ * Samples the layers of the complex into C->ctx->estimate. Each layer is
+ * built from a sample of at most estimate->samples states of the layer
+ * before, picked at random, much as a Knuth probe follows a random path
+ * through a search tree. The states found from a sample that covers a
+ * fraction f of its layer are counted with the Chao1 estimator from how many
+ * of them were found once and twice, and the states of the layer before last
+ * that were found but left out of its sample are discounted. The time taken
+ * to find the rectangles of each sampled state calibrates the runtime.
+ * @param C a complex prepared by init_complex
+ * @param init B_0, whose tags start at 1. Freed by this function
+ */
+static void estimate_complex(struct Complex *C, StateRBTree init) {
+  HFKEstimate_t *E = C->ctx->estimate;
+  const double state_bytes = sizeof(StateRBTreeNode_t) + C->K.arc_index;
+  StateRBTree sample = init, prevs = EMPTY_TREE;
+  StateTreeIter_t *iter;
+  double fraction = 1, prev_fraction = 1;
+  double edges_so_far = 0;
+  long expanded = 0;
+  int limit = HFK_ESTIMATE_LAYERS;
+  struct timespec start, end;
+
+  if (C->ctx->max_layers > 0 && 2 * C->ctx->max_layers + 1 < limit) {
+    limit = 2 * C->ctx->max_layers + 1;
+  }
+
+  E->states[0] = 0;
+  for (iter = s_create_iter(init); s_has_next(iter); s_get_next(iter)) {
+    E->states[0]++;
+  }
+  s_free_iter(iter);
+  E->edges[0] = E->states[0];
+  E->layers = 1;
+  E->exact = 1;
+  E->peak_bytes = E->states[0] * state_bytes;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (int i = 1; i < limit && EMPTY_TREE != sample && !is_cancelled(C);
+       ++i) {
+    StateRBTree found = EMPTY_TREE;
+    double edges = 0, stale = 0, distinct = 0, once = 0, twice = 0;
+
+    for (iter = s_create_iter(sample); s_has_next(iter);) {
+      StateRBTree candidates = new_candidates(
+          C, &C->scratch[0], s_get_next(iter)->data, EMPTY_TREE, i % 2);
+      StateTreeIter_t *cand_iter;
+      int hits = 0;
+      expanded++;
+      for (cand_iter = s_create_iter(candidates); s_has_next(cand_iter);) {
+        StateRBTree candidate = s_get_next(cand_iter);
+        if (s_is_member(&prevs, candidate->data, &C->K)) {
+          hits++;
+          continue;
+        }
+        StateRBTree node = s_find_node(&found, candidate->data, &C->K);
+        if (EMPTY_TREE == node) {
+          s_insert_tagged_data(&found, candidate->data, 1, &C->K);
+          candidate->data = NULL;
+        } else {
+          node->tag++;
+        }
+        edges++;
+      }
+      s_free_iter(cand_iter);
+      free_state_rbtree(&candidates);
+      // Each sampled state was found from one state of the sample before,
+      // the rest of the layer before is only hit at the rate it was sampled
+      if (hits > 1) {
+        stale += (hits - 1) * (1 / prev_fraction - 1);
+      }
+    }
+    s_free_iter(iter);
+
+    for (iter = s_create_iter(found); s_has_next(iter);) {
+      const int tag = s_get_next(iter)->tag;
+      distinct++;
+      once += (1 == tag);
+      twice += (2 == tag);
+    }
+    s_free_iter(iter);
+
+    double states = distinct;
+    if (fraction < 1) {
+      states += (twice > 0) ? once * once / (2 * twice)
+                            : once * (once - 1) / 2;
+    }
+    // Rectangles into states of the layer before last that were left out of
+    // its sample lead back rather than into the new layer
+    double kept = 1;
+    if (stale > 0 && edges > 0) {
+      kept = (stale < edges) ? 1 - stale / edges : 0;
+    }
+    E->states[i] = states * kept;
+    E->edges[i] = edges / fraction * kept;
+    E->layers = i + 1;
+    if (E->exact == i && 1 == fraction && 1 == prev_fraction) {
+      E->exact = i + 1;
+    }
+
+    // The calculation keeps every edge and four layers of states
+    edges_so_far += E->edges[i];
+    double live = 0;
+    for (int j = (i < 3) ? 0 : i - 3; j <= i; ++j) {
+      live += E->states[j];
+    }
+    const double bytes = edges_so_far * sizeof(EdgeNode_t) + live * state_bytes;
+    if (bytes > E->peak_bytes) {
+      E->peak_bytes = bytes;
+    }
+
+    free_state_rbtree(&prevs);
+    prevs = sample;
+    prev_fraction = fraction;
+    sample = sample_layer(&found, (int)distinct, E->samples, &E->seed, &C->K);
+    if (distinct <= E->samples) {
+      fraction = 1;
+    } else {
+      fraction = E->samples / ((E->states[i] > distinct) ? E->states[i]
+                                                         : distinct);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  E->seconds_per_state =
+      (expanded > 0) ? ((end.tv_sec - start.tv_sec) +
+                        (end.tv_nsec - start.tv_nsec) / 1e9) /
+                           expanded
+                     : 0;
+  free_state_rbtree(&prevs);
+  free_state_rbtree(&sample);
+}
+
+/**
+ * Picks about samples of the states of layer at random, each with the same
+ * chance, and moves them into a new tree. The rest are freed with layer.
+ * @param layer a tree of states, freed by this function
+ * @param size the number of states in layer
+ * @param samples the number of states to keep
+ * @param seed the state of the random number generator
+ * @param G the grid the states belong to
+ * @return a tree of the states kept
+ */
+static StateRBTree sample_layer(StateRBTree *layer, const int size,
+                                const int samples, unsigned int *seed,
+                                const Grid_t *const G) {
+  StateRBTree sample = EMPTY_TREE;
+  StateTreeIter_t *iter;
+
+  for (iter = s_create_iter(*layer); s_has_next(iter);) {
+    StateRBTree node = s_get_next(iter);
+    if (size <= samples ||
+        rand_r(seed) < (double)samples / size * ((double)RAND_MAX + 1)) {
+      s_insert_data(&sample, node->data, G);
+      node->data = NULL;
+    }
+  }
+  s_free_iter(iter);
+  free_state_rbtree(layer);
+
+  return sample;
+}
+
+/**
+ * Builds the next layer dest out of the layer present. For each state of
+ * present the states reached by rectangles (into present when into is
+ * nonzero, out of present otherwise) that are not in prevs are added to dest
+ * and an edge is recorded for each of them.
+ *
+ * A single worker interns the states of dest in a StateTable, whose IDs
+ * number them in the order they are found and serve as their tags. With
+ * more than one worker the rectangles of all of present are found in
+ * parallel, then the workers add them to a shared StateHashSet at the same
+ * time. Each worker keeps its own edges, which are joined at the end. The
+ * states of dest are then numbered in whatever order the workers reached
+ * them.
+ * @param C a complex
+ * @param present the current layer
+ * @param present_offset added to the tags of present to give vertex numbers
+ * @param prevs the layer preceding present on the same side as dest
+ * @param dest the layer being built
+ * @param dest_offset added to the tags of dest to give vertex numbers
+ * @param into nonzero to follow rectangles into present
+ * @param edges the EdgeList new edges are prepended to
+ * @param edge_count incremented for each new edge
+ * @return the number of states in present
+ */
+static int expand_layer(struct Complex *C, const struct Layer *present,
+                        const int present_offset, const struct Layer *prevs,
+                        struct Layer *dest, const int dest_offset,
+                        const int into, EdgeList *edges, int *edge_count) {
+  int total = 0;
+
+  dest->order = present->order + 1;
+  for (int i = 0; i < C->workers; ++i) {
+    C->scratch[i].states = 0;
+    C->scratch[i].found = 0;
+    C->scratch[i].edges = NULL;
+    C->scratch[i].edge_count = 0;
+    C->scratch[i].cand.rectangles = 0;
+    C->scratch[i].cand.cancelled = 0;
+    C->scratch[i].cand.prev_hits = 0;
+    C->scratch[i].cache_hits = 0;
+    C->scratch[i].cache_misses = 0;
+  }
+
+  if (NULL == C->scheduler) {
+    State *frontier;
+    int *tags;
+    const int start_edges = *edge_count;
+    const int count = collect_layer(C->ctx, present, &frontier, &tags);
+    // A packed layer is searched after the rectangles are toggled, as the
+    // workers do with every layer
+    const struct Layer *excluded = (NULL == prevs->packed) ? NULL : prevs;
+    dest->table = create_state_table(C->K.arc_index);
+    C->scratch[0].cand.prev_table = prevs->table;
+    C->scratch[0].cand.toggled = create_state_table(C->K.arc_index);
+    for (int i = 0; i < count; ++i) {
+      if (is_cancelled(C) ||
+          over_memory(C, dest, *edge_count - start_edges)) {
+        break;
+      }
+      new_candidates(C, &C->scratch[0], frontier[i], prevs->tree, into);
+      total++;
+      const int known = dest->table->count;
+      add_candidates(C, &C->scratch[0].cand, excluded, tags[i] + present_offset,
+                     dest->table, dest_offset, into, edges, edge_count);
+      if (records_parents(C)) {
+        // The new states are given IDs in the order they were found
+        for (int tag = known + 1; tag <= dest->table->count; ++tag) {
+          record_parent(dest, tag, tags[i]);
+        }
+      }
+    }
+    C->scratch[0].cand.prev_table = NULL;
+    free_state_table(C->scratch[0].cand.toggled);
+    C->scratch[0].cand.toggled = NULL;
+    hfk_free(C->ctx, frontier);
+    hfk_free(C->ctx, tags);
+    return total;
+  }
+
+  struct ExpandTask task;
+  long found = 0;
+  task.C = C;
+  task.prevs = prevs;
+  task.dest = dest;
+  task.present_offset = present_offset;
+  task.dest_offset = dest_offset;
+  task.into = into;
+  total = collect_layer(C->ctx, present, &task.frontier, &task.tags);
+  task.results =
+      hfk_alloc(C->ctx, sizeof(StateRBTree) * (total > 0 ? total : 1));
+
+  reset_worker_stats(C->scheduler);
+  run_tasks(C->scheduler, total, find_candidates_task, &task);
+
+  for (int i = 0; i < C->workers; ++i) {
+    found += C->scratch[i].found;
+  }
+  if (found > 0) {
+    dest->set = create_hash_set(found, C->K.arc_index);
+    if (records_parents(C)) {
+      dest->parents = malloc(sizeof(int) * found);
+      dest->parent_capacity = found;
+    }
+    run_tasks(C->scheduler, total, add_candidates_task, &task);
+  } else {
+    for (int i = 0; i < total; ++i) {
+      free_state_rbtree(&task.results[i]);
+    }
+  }
+
+  for (int i = 0; i < C->workers; ++i) {
+    EdgeList last = C->scratch[i].edges;
+    if (NULL != last) {
+      while (NULL != last->nextEdge) {
+        last = last->nextEdge;
+      }
+      last->nextEdge = *edges;
+      *edges = C->scratch[i].edges;
+    }
+    *edge_count += C->scratch[i].edge_count;
+  }
+
+  hfk_free(C->ctx, task.results);
+  hfk_free(C->ctx, task.frontier);
+  hfk_free(C->ctx, task.tags);
+  return total;
+}
+
+/**
+ * Task run by the scheduler to find the rectangles of the item-th state of
+ * the frontier. The states of prevs are left in and removed by
+ * add_candidates_task.
+ * @param item an index into the frontier
+ * @param worker the worker running the task
+ * @param data a struct ExpandTask
+ */
+static void find_candidates_task(const int item, const int worker,
+                                 void *data) {
+  struct ExpandTask *task = data;
+  struct Scratch *S = &task->C->scratch[worker];
+  if (is_cancelled(task->C)) {
+    task->results[item] = EMPTY_TREE;
+    return;
+  }
+  task->results[item] = new_candidates(task->C, S, task->frontier[item],
+                                       EMPTY_TREE, task->into);
+  S->found += S->cand.size;
+}
+
+/**
+ * Task run by the scheduler to add the rectangles found for the item-th
+ * state of the frontier to the shared set of the layer being built.
+ * @param item an index into the frontier
+ * @param worker the worker running the task
+ * @param data a struct ExpandTask
+ */
+static void add_candidates_task(const int item, const int worker,
+                                void *data) {
+  struct ExpandTask *task = data;
+  struct Scratch *S = &task->C->scratch[worker];
+  const int present_number = task->tags[item] + task->present_offset;
+  StateTreeIter_t *iter;
+
+  if (is_cancelled(task->C)) {
+    free_state_rbtree(&task->results[item]);
+    return;
+  }
+
+  for (iter = s_create_iter(task->results[item]); s_has_next(iter);) {
+    StateRBTree candidate = s_get_next(iter);
+    int tag;
+    if (layer_contains(task->prevs, candidate->data, &task->C->K)) {
+      S->cand.prev_hits++;
+      continue;
+    }
+    if (hash_set_insert(task->dest->set, candidate->data, &tag)) {
+      candidate->data = NULL;
+      if (NULL != task->dest->parents) {
+        // Each tag is handed out once, so no other worker writes here
+        task->dest->parents[tag - 1] = task->tags[item];
+      }
+    }
+    if (task->C->ctx->count_only) {
+      // Only the number of edges is wanted
+    } else if (task->into) {
+      S->edges = prepend_edge(tag + task->dest_offset, present_number,
+                              S->edges);
+    } else {
+      S->edges = prepend_edge(present_number, tag + task->dest_offset,
+                              S->edges);
+    }
+    S->edge_count++;
+  }
+  s_free_iter(iter);
+  free_state_rbtree(&task->results[item]);
+}
+
+/**
+ * Finds the states reached by rectangles into or out of incoming that are
+ * not in prevs, counted mod 2.
+ * @param C a complex
+ * @param S the scratch space of the calling worker
+ * @param incoming a state of C (flattened if C is a lift)
+ * @param prevs excluded states
+ * @param into nonzero for rectangles into incoming, zero for out of
+ * @return a StateRBTree of the states found, empty if S->cand.toggled is
+ * set, in which case they are the states of odd parity in that table
+ */
+static StateRBTree new_candidates(const struct Complex *C, struct Scratch *S,
+                                  const State incoming,
+                                  const StateRBTree prevs, const int into) {
+  struct Candidates *cand = &S->cand;
+  const int direction = into ? RECTANGLES_INTO : RECTANGLES_OUT;
+  rectangle_fn fn = toggle_candidate;
+  void *data = cand;
+  cand->incoming = incoming;
+  cand->prevs = prevs;
+  cand->ans = EMPTY_TREE;
+  cand->size = 0;
+  if (NULL != cand->toggled) {
+    clear_state_table(cand->toggled);
+  }
+  memcpy(cand->temp_state, incoming, C->K.arc_index);
+  S->states++;
+  PROFILE_START(start);
+
+  if (NULL != C->cache) {
+    const unsigned short *pairs;
+    const int count =
+        rectangle_cache_get(C->cache, incoming, direction, &pairs);
+    if (count >= 0) {
+      S->cache_hits++;
+      for (int i = 0; i < count; ++i) {
+        toggle_candidate(pairs[2 * i], pairs[2 * i + 1], cand);
+      }
+      PROFILE_STOP(PROFILE_ENUMERATE, start);
+      return cand->ans;
+    }
+    S->cache_misses++;
+    if (!C->compact) {
+      S->pair_count = 0;
+      fn = record_candidate;
+      data = S;
+    }
+  }
+
+  if (NULL == C->L) {
+    if (into) {
+      rectangles_into_internal(incoming, C->G, fn, data);
+    } else {
+      rectangles_out_of_internal(incoming, C->G, fn, data);
+    }
+  } else if (into) {
+    for (int sheet = 0; sheet < C->L->sheets; ++sheet) {
+      for (int col = 0; col < C->L->arc_index; ++col) {
+        S->mirrored[lift_position(sheet, col, C->L, 1)] =
+            incoming[sheet * C->L->arc_index + col];
+      }
+    }
+    lift_rectangles_internal(S->mirrored_rows, C->L_mirror, 1, fn, data);
+  } else {
+    for (int sheet = 0; sheet < C->L->sheets; ++sheet) {
+      S->rows[sheet] = &incoming[sheet * C->L->arc_index];
+    }
+    lift_rectangles_internal(S->rows, C->L, 0, fn, data);
+  }
+
+  if (NULL != C->cache && !C->compact) {
+    const size_t size = sizeof(unsigned short) * 2 * S->pair_count;
+    unsigned short *pairs = malloc(size > 0 ? size : 1);
+    memcpy(pairs, S->pairs, size);
+    rectangle_cache_put(C->cache, incoming, direction, pairs, S->pair_count);
+  }
+
+  PROFILE_STOP(PROFILE_ENUMERATE, start);
+  return cand->ans;
+}
+
+/**
+ * Adds the states of candidates that are not already in dest to dest and
+ * records an edge between present_number and each of them. The states are
+ * copied from the toggled table of candidates into dest, whose IDs are the
+ * tags of the layer, in the order they were first found.
+ * @param C a complex
+ * @param candidates the states found from a single state of the present
+ * layer, interned in candidates->toggled
+ * @param excluded a layer whose states are skipped, or NULL
+ * @param present_number the vertex number of that state
+ * @param dest the table of the layer being built
+ * @param dest_offset added to the IDs of dest to give vertex numbers
+ * @param into nonzero if the edges point into the present state
+ * @param edges the EdgeList new edges are prepended to
+ * @param edge_count incremented for each new edge
+ */
+static void add_candidates(const struct Complex *C,
+                           struct Candidates *candidates,
+                           const struct Layer *excluded,
+                           const int present_number, StateTable_t *dest,
+                           const int dest_offset, const int into,
+                           EdgeList *edges, int *edge_count) {
+  for (int found = 1; found <= candidates->toggled->count; ++found) {
+    if (!candidates->odd[found - 1]) {
+      continue;
+    }
+    const State candidate = state_table_state(candidates->toggled, found);
+    if (NULL != excluded && layer_contains(excluded, candidate, &C->K)) {
+      candidates->prev_hits++;
+      continue;
+    }
+    int id;
+    state_table_intern(dest, candidate, &id);
+    const int number = id + dest_offset;
+    if (C->ctx->count_only) {
+      // Only the number of edges is wanted
+    } else if (into) {
+      *edges = prepend_edge(number, present_number, *edges);
+    } else {
+      *edges = prepend_edge(present_number, number, *edges);
+    }
+    (*edge_count)++;
+  }
+}
+
+/**
+ * Prints the per worker counters of the last layer when running with more
+ * than one worker.
+ * @param C a complex
+ */
+static void print_worker_stats(const struct Complex *C) {
+  if (NULL == C->scheduler) {
+    return;
+  }
+  for (int i = 0; i < C->workers; ++i) {
+    hfk_printf(C->ctx, "Worker %d: %ld states, %ld rectangles, %ld steals\n",
+               i, C->scratch[i].states, C->scratch[i].cand.rectangles,
+               C->scheduler->stats[i].steals);
+  }
+  hfk_printf(C->ctx, "\n");
+}
+
+/**
+ * Adds the counters of the layer just built to the statistics of the context
+ * @param C a complex
+ * @param total the number of states the layer was built from
+ */
+static void record_layer(struct Complex *C, const int total) {
+  C->ctx->stats.layers++;
+  C->ctx->stats.states += total;
+  for (int i = 0; i < C->workers; ++i) {
+    C->ctx->stats.rectangles += C->scratch[i].cand.rectangles;
+    C->ctx->stats.cache_hits += C->scratch[i].cache_hits;
+    C->ctx->stats.cache_misses += C->scratch[i].cache_misses;
+  }
+}
+
+/**
+ * Copies the states of layer and their tags into arrays allocated with the
+ * allocator of ctx
+ * @param ctx a context
+ * @param layer a layer
+ * @param states destination for the states
+ * @param tags destination for the tags
+ * @return the number of states in layer
+ */
+static int collect_layer(const HFKContext_t *const ctx,
+                         const struct Layer *layer, State **states,
+                         int **tags) {
+  int count = 0;
+
+  if (NULL != layer->set) {
+    *states = hfk_alloc(ctx, sizeof(State) * (layer->set->count + 1));
+    *tags = hfk_alloc(ctx, sizeof(int) * (layer->set->count + 1));
+    for (long i = 0; i < layer->set->capacity; ++i) {
+      if (NULL != layer->set->keys[i]) {
+        (*states)[count] = layer->set->keys[i];
+        (*tags)[count] = layer->set->tags[i];
+        count++;
+      }
+    }
+    return count;
+  }
+
+  if (NULL != layer->table) {
+    count = layer->table->count;
+    *states = hfk_alloc(ctx, sizeof(State) * (count + 1));
+    *tags = hfk_alloc(ctx, sizeof(int) * (count + 1));
+    for (int i = 0; i < count; ++i) {
+      (*states)[i] = state_table_state(layer->table, i + 1);
+      (*tags)[i] = i + 1;
+    }
+    return count;
+  }
+
+  if (NULL != layer->packed && NULL != layer->packed->states) {
+    count = layer->packed->count;
+    *states = hfk_alloc(ctx, sizeof(State) * (count + 1));
+    *tags = hfk_alloc(ctx, sizeof(int) * (count + 1));
+    for (int i = 0; i < count; ++i) {
+      (*states)[i] = &layer->packed->states[i * layer->packed->key_len];
+      (*tags)[i] = layer->packed->tags[i];
+    }
+    return count;
+  }
+
+  if (NULL != layer->packed) {
+    // The states of a delta layer are rebuilt after the pointers, in the
+    // same block, so that freeing the pointers frees them too
+    const int key_len = layer->packed->key_len;
+    count = layer->packed->count;
+    *states = hfk_alloc(ctx, sizeof(State) * (count + 1) +
+                                 sizeof(char) * count * key_len);
+    *tags = hfk_alloc(ctx, sizeof(int) * (count + 1));
+    char *data = (char *)(*states + count + 1);
+    for (int i = 0; i < count; ++i) {
+      (*states)[i] = &data[i * key_len];
+      unpack_state(layer->packed, i, (*states)[i]);
+      (*tags)[i] = layer->packed->tags[i];
+    }
+    return count;
+  }
+
+  StateTreeIter_t *iter;
+  for (iter = s_create_iter(layer->tree); s_has_next(iter);) {
+    s_get_next(iter);
+    count++;
+  }
+  s_free_iter(iter);
+
+  *states = hfk_alloc(ctx, sizeof(State) * (count + 1));
+  *tags = hfk_alloc(ctx, sizeof(int) * (count + 1));
+  count = 0;
+  for (iter = s_create_iter(layer->tree); s_has_next(iter);) {
+    StateRBTree node = s_get_next(iter);
+    (*states)[count] = node->data;
+    (*tags)[count] = node->tag;
+    count++;
+  }
+  s_free_iter(iter);
+
+  return count;
+}
+
+/**
+ * @param layer a layer
+ * @return nonzero if layer has no states
+ */
+static int layer_is_empty(const struct Layer *layer) {
+  return EMPTY_TREE == layer->tree &&
+         (NULL == layer->set || 0 == layer->set->count) &&
+         (NULL == layer->table || 0 == layer->table->count) &&
+         (NULL == layer->packed || 0 == layer->packed->count);
+}
+
+/**
+ * @param layer a layer
+ * @return the number of states in layer
+ */
+static int layer_size(const struct Layer *layer) {
+  if (NULL != layer->set) {
+    return layer->set->count;
+  }
+  if (NULL != layer->table) {
+    return layer->table->count;
+  }
+  if (NULL != layer->packed) {
+    return layer->packed->count;
+  }
+
+  int size = 0;
+  StateTreeIter_t *iter;
+  for (iter = s_create_iter(layer->tree); s_has_next(iter); s_get_next(iter)) {
+    size++;
+  }
+  s_free_iter(iter);
+  return size;
+}
+
+/**
+ * Prints the size of a layer just built when only counting, together with
+ * the memory taken by the layers being kept and the memory the edges found
+ * so far would take in a full calculation
+ * @param C a complex
+ * @param side 'A' or 'B'
+ * @param pos the index of the layer
+ * @param layer the layer
+ * @param edges the number of edges found while building layer
+ * @param edge_count the number of edges found so far
+ * @param live the layers being kept
+ */
+static void print_layer_count(const struct Complex *C, const char side,
+                              const int pos, const struct Layer *layer,
+                              const int edges, const int edge_count,
+                              const struct Layer *const live[4]) {
+  double bytes = (double)edge_count * sizeof(EdgeNode_t);
+  for (int i = 0; i < 4; ++i) {
+    bytes += layer_bytes(C, live[i]);
+  }
+  hfk_printf(C->ctx, "%c_%d: %d states, %d edges, %.1f MB\n", side, pos,
+             layer_size(layer), edges, bytes / 1e6);
+}
+
+/**
+ * @param layer a layer
+ * @param s a state
+ * @param K the grid describing the states of layer
+ * @return nonzero if s is in layer
+ */
+static int layer_contains(const struct Layer *layer, const State s,
+                          const Grid_t *const K) {
+  if (NULL != layer->set) {
+    return 0 != hash_set_tag(layer->set, s);
+  }
+  if (NULL != layer->table) {
+    return 0 != state_table_id(layer->table, s);
+  }
+  if (NULL != layer->packed) {
+    const struct PackedLayer *packed = layer->packed;
+    char buf[packed->key_len];
+    int lo = 0, hi = packed->count;
+    while (lo < hi) {
+      const int mid = lo + (hi - lo) / 2;
+      State key = &buf[0];
+      if (NULL != packed->states) {
+        key = &packed->states[mid * packed->key_len];
+      } else {
+        unpack_state(packed, mid, key);
+      }
+      const int comp = comp_state(key, s, K);
+      if (0 == comp) {
+        return 1;
+      } else if (comp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return 0;
+  }
+  return s_is_member(&layer->tree, s, K);
+}
+
+/**
+ * Starts an empty layer, or one holding the states of tree
+ * @param layer the layer
+ * @param tree the states of the layer, tagged from 1
+ */
+static void init_layer(struct Layer *layer, StateRBTree tree) {
+  layer->tree = tree;
+  layer->set = NULL;
+  layer->table = NULL;
+  layer->packed = NULL;
+  layer->parents = NULL;
+  layer->parent_capacity = 0;
+  layer->order = 0;
+}
+
+/**
+ * Frees the states of layer and empties it. A packed layer the delta layers
+ * of later layers still refer to is kept until they are freed too.
+ * @param layer a layer
+ */
+static void free_layer(struct Layer *layer) {
+  free_state_rbtree(&layer->tree);
+  if (NULL != layer->set) {
+    free_hash_set(layer->set);
+    layer->set = NULL;
+  }
+  if (NULL != layer->table) {
+    free_state_table(layer->table);
+    layer->table = NULL;
+  }
+  if (NULL != layer->packed) {
+    release_packed(layer->packed);
+    layer->packed = NULL;
+  }
+  free(layer->parents);
+  layer->parents = NULL;
+  layer->parent_capacity = 0;
+}
+
+/**
+ * Drops a reference to a packed layer, freeing it and releasing its parent
+ * once nothing refers to it
+ * @param packed a packed layer
+ */
+static void release_packed(struct PackedLayer *packed) {
+  while (NULL != packed && 0 == --packed->refs) {
+    struct PackedLayer *parent = packed->parent;
+    free(packed->states);
+    free(packed->deltas);
+    free(packed->tags);
+    free(packed);
+    packed = parent;
+  }
+}
+
+/**
+ * Rebuilds the p-th state of a packed layer by following its deltas back to
+ * a full state and swapping the columns recorded at each step
+ * @param packed a packed layer
+ * @param p the position of the state in packed
+ * @param s destination for the state
+ */
+static void unpack_state(const struct PackedLayer *packed, const int p,
+                         State s) {
+  if (NULL != packed->states) {
+    memcpy(s, &packed->states[p * packed->key_len], packed->key_len);
+    return;
+  }
+  const struct DeltaState *delta = &packed->deltas[p];
+  unpack_state(packed->parent, delta->parent, s);
+  const char temp = s[delta->i];
+  s[delta->i] = s[delta->j];
+  s[delta->j] = temp;
+}
+
+/**
+ * Records the state of a layer a new state was found from, growing the
+ * record as needed
+ * @param layer the layer being built
+ * @param tag the tag of the new state
+ * @param parent the tag of the state it was found from
+ */
+static void record_parent(struct Layer *layer, const int tag,
+                          const int parent) {
+  if (tag > layer->parent_capacity) {
+    layer->parent_capacity =
+        (tag > 2 * layer->parent_capacity) ? tag : 2 * layer->parent_capacity;
+    layer->parents =
+        realloc(layer->parents, sizeof(int) * layer->parent_capacity);
+  }
+  layer->parents[tag - 1] = parent;
+}
+
+/**
+ * @param C a complex
+ * @return nonzero if the layers being built record the states they were
+ * found from, so that they can be packed as deltas
+ */
+static int records_parents(const struct Complex *C) {
+  return C->ctx->max_memory > 0 && C->K.arc_index >= DELTA_MIN_KEY_LEN;
+}
+
+/**
+ * @param C a complex
+ * @param layer a layer
+ * @return the number of bytes taken by the states of layer
+ */
+static double layer_bytes(const struct Complex *C, const struct Layer *layer) {
+  const double parents = (double)layer->parent_capacity * sizeof(int);
+  if (NULL != layer->set) {
+    return (double)layer->set->capacity * (sizeof(State) + sizeof(int)) +
+           (double)layer->set->count * C->K.arc_index + parents;
+  }
+  if (NULL != layer->table) {
+    return (double)layer->table->capacity * sizeof(int) +
+           (double)layer->table->room * C->K.arc_index + parents;
+  }
+  if (NULL != layer->packed) {
+    return packed_bytes(layer->packed);
+  }
+  return (double)layer_size(layer) *
+             (sizeof(StateRBTreeNode_t) + C->K.arc_index) +
+         parents;
+}
+
+/**
+ * @param packed a packed layer
+ * @return the number of bytes taken by packed, not counting its parent
+ */
+static double packed_bytes(const struct PackedLayer *packed) {
+  if (NULL != packed->states) {
+    return (double)packed->count * (packed->key_len + sizeof(int));
+  }
+  return (double)packed->count * (sizeof(struct DeltaState) + sizeof(int));
+}
+
+/**
+ * @param C a complex
+ * @return the number of bytes taken by the rectangle cache of C, 0 without
+ * one
+ */
+static double cache_bytes(const struct Complex *C) {
+  return (NULL != C->cache) ? (double)rectangle_cache_bytes(C->cache) : 0;
+}
+
+/**
+ * @param a a layer
+ * @param b another layer
+ * @return the number of bytes taken by the packed layers the deltas of a
+ * and b refer to, other than a and b themselves
+ */
+static double retained_bytes(const struct Layer *a, const struct Layer *b) {
+  const struct PackedLayer *seen[2 * DELTA_MAX_DEPTH + 2];
+  int num_seen = 0;
+  double bytes = 0;
+
+  seen[num_seen++] = a->packed;
+  seen[num_seen++] = b->packed;
+  for (int k = 0; k < 2; ++k) {
+    const struct PackedLayer *packed = (0 == k) ? a->packed : b->packed;
+    for (packed = (NULL == packed) ? NULL : packed->parent; NULL != packed;
+         packed = packed->parent) {
+      int known = 0;
+      for (int i = 0; i < num_seen; ++i) {
+        known = known || seen[i] == packed;
+      }
+      if (!known) {
+        seen[num_seen++] = packed;
+        bytes += packed_bytes(packed);
+      }
+    }
+  }
+  return bytes;
+}
+
+/**
+ * Replaces the states of layer by a single array of the states sorted by
+ * comp_state, keeping their tags. A packed layer takes a fraction of the
+ * memory of a tree or a hash set and is searched by bisection.
+ *
+ * Every state of a layer is a state of the layer it was built from with two
+ * columns swapped. When layer recorded where its states came from and
+ * parent is packed, each state may instead be kept as the position of its
+ * parent and the two columns, rebuilt on demand by following the chain of
+ * deltas back to a full layer. The layers along the chain are kept as long
+ * as layer is, so deltas are only used when they and the chain take less
+ * memory than the full states.
+ * @param C a complex
+ * @param layer a layer, left alone if it is already packed
+ * @param parent the layer layer was built from, or NULL
+ */
+static void pack_layer(const struct Complex *C, struct Layer *layer,
+                       const struct Layer *parent) {
+  struct PackedLayer *packed = NULL;
+  State *states;
+  int *tags;
+
+  if (NULL != layer->packed) {
+    return;
+  }
+  const int count = collect_layer(C->ctx, layer, &states, &tags);
+  sort_states(states, tags, count, C->K.arc_index);
+
+  if (NULL != layer->parents && NULL != parent && NULL != parent->packed) {
+    packed = delta_pack(C, layer, parent, states, tags, count);
+    if (NULL != packed && C->ctx->verbosity >= QUIET) {
+      hfk_printf(C->ctx, "Packed %d states as deltas from the layer before\n",
+                 count);
+    }
+  }
+  if (NULL == packed) {
+    packed = malloc(sizeof(struct PackedLayer));
+    packed->count = count;
+    packed->key_len = C->K.arc_index;
+    packed->states = malloc(sizeof(char) * count * C->K.arc_index + 1);
+    packed->deltas = NULL;
+    packed->tags = malloc(sizeof(int) * (count + 1));
+    packed->depth = 0;
+    packed->refs = 1;
+    packed->parent = NULL;
+    for (int i = 0; i < count; ++i) {
+      memcpy(&packed->states[i * C->K.arc_index], states[i], C->K.arc_index);
+      packed->tags[i] = tags[i];
+    }
+  }
+  hfk_free(C->ctx, states);
+  hfk_free(C->ctx, tags);
+
+  free_layer(layer);
+  layer->packed = packed;
+}
 
-    return 1;
+/**
+ * Packs the states of layer as deltas from the packed layer parent
+ * @param C a complex
+ * @param layer a layer that recorded the tags of the states of parent its
+ * states were found from
+ * @param parent the packed layer layer was built from
+ * @param states the states of layer, sorted by comp_state
+ * @param tags the tags of states
+ * @param count the number of states
+ * @return the packed layer, or NULL if the chain of deltas would be too
+ * long or take more memory than the full states
+ */
+static struct PackedLayer *delta_pack(const struct Complex *C,
+                                      const struct Layer *layer,
+                                      const struct Layer *parent,
+                                      State *states, int *tags,
+                                      const int count) {
+  struct PackedLayer *from = parent->packed;
+  const int key_len = C->K.arc_index;
+  double chain = 0;
+  int ok = 1;
+
+  if (from->depth >= DELTA_MAX_DEPTH) {
+    return NULL;
+  }
+  for (const struct PackedLayer *p = from; NULL != p; p = p->parent) {
+    chain += packed_bytes(p);
+  }
+  if ((double)count * sizeof(struct DeltaState) + chain >=
+      (double)count * key_len) {
+    return NULL;
   }
 
-  if (d1_states != NULL) {
-    int i = 1;
-    StateList temp;
-    edge_list = create_edge(0, 1);
-    s_insert_tagged_data(&new_ins, d1_states->data, 1, G);
-
-    temp = d1_states;
-    d1_states = d1_states->nextState;
-    free(temp);
-    while (d1_states != NULL) {
-      i++;
-      edge_list = append_ordered(0, i, edge_list);
-      s_insert_tagged_data(&new_ins, d1_states->data, i, G);
-      temp = d1_states;
-      d1_states = d1_states->nextState;
-      free(temp);
+  // The tags of a layer run from 1 to its size
+  int *position = malloc(sizeof(int) * (from->count + 1));
+  for (int p = 0; p < from->count; ++p) {
+    position[p] = -1;
+  }
+  for (int p = 0; p < from->count && ok; ++p) {
+    ok = from->tags[p] >= 1 && from->tags[p] <= from->count;
+    if (ok) {
+      position[from->tags[p] - 1] = p;
     }
   }
 
-  ans = 0;
-  int current_pos = 1;
-
-  while (new_ins != EMPTY_TREE && !ans) {
-    num_new_outs = 0;
-    total_in = 0;
-    new_outs = EMPTY_TREE;
-    EdgeList new_edges = NULL;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering A_%d:\n", current_pos);
+  struct DeltaState *deltas =
+      malloc(sizeof(struct DeltaState) * (count + 1));
+  char *buf = malloc(sizeof(char) * key_len);
+  for (int p = 0; p < count && ok; ++p) {
+    int q = -1, i = -1, j = -1;
+    if (tags[p] >= 1 && tags[p] <= layer->parent_capacity) {
+      const int tag = layer->parents[tags[p] - 1];
+      q = (tag >= 1 && tag <= from->count) ? position[tag - 1] : -1;
     }
-
-    // Build A_i by looking for states into B_(i-1) that are not in A_(i-1)
-    StateTreeIter_t *present_iter;
-    for (present_iter = s_create_iter(new_ins); s_has_next(present_iter);) {
-      StateRBTree present_in = s_get_next(present_iter);
-      total_in++;
-      potential_outs = new_rectangles_into(prev_outs, present_in->data, G);
-
-      StateTreeIter_t *potential_iter;
-      for (potential_iter = s_create_iter(potential_outs);
-           s_has_next(potential_iter);) {
-        StateRBTree potential_out = s_get_next(potential_iter);
-        StateRBTree node = s_find_node(&new_outs, potential_out->data, G);
-        if (EMPTY_TREE == node) {
-          State t = malloc(sizeof(char) * G->arc_index);
-          copy_state(&t, &(potential_out->data), G);
-          num_new_outs++;
-          s_insert_tagged_data(&new_outs, t, num_new_outs, G);
-          new_edges = prepend_edge(num_new_outs + num_outs,
-                                   present_in->tag + num_ins, new_edges);
-        } else {
-          new_edges = prepend_edge(node->tag + num_outs,
-                                   present_in->tag + num_ins, new_edges);
+    if (q >= 0) {
+      unpack_state(from, q, buf);
+      for (int k = 0; k < key_len; ++k) {
+        if (buf[k] != states[p][k]) {
+          if (i < 0) {
+            i = k;
+          } else if (j < 0) {
+            j = k;
+          } else {
+            j = -1;
+            break;
+          }
         }
-        edge_count++;
       }
-
-      free_state_rbtree(&potential_outs);
-      s_free_iter(potential_iter);
-    }
-    s_free_iter(present_iter);
-
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
     }
-    free_state_rbtree(&prev_ins);
-    prev_ins = new_ins;
-    num_ins = num_ins + total_in;
-    prev_in_number = num_ins;
-    num_new_ins = 0;
-    new_ins = EMPTY_TREE;
-    total_out = 0;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering B_%d:\n", current_pos);
+    ok = j >= 0 && buf[i] == states[p][j] && buf[j] == states[p][i];
+    if (ok) {
+      deltas[p].parent = q;
+      deltas[p].i = i;
+      deltas[p].j = j;
     }
+  }
+  free(buf);
+  free(position);
+  if (!ok) {
+    free(deltas);
+    return NULL;
+  }
 
-    // Build B_i by finding states out of A_i that are not in B_(i-1)
-    for (present_iter = s_create_iter(new_outs); s_has_next(present_iter);) {
-      StateRBTree present_out = s_get_next(present_iter);
-      total_out++;
-      potential_ins = new_rectangles_out_of(prev_ins, present_out->data, G);
-
-      StateTreeIter_t *potential_iter;
-      for (potential_iter = s_create_iter(potential_ins);
-           s_has_next(potential_iter);) {
-        StateRBTree potential_in = s_get_next(potential_iter);
-        StateRBTree node = s_find_node(&new_ins, potential_in->data, G);
-        if (EMPTY_TREE == node) {
-          State t = malloc(sizeof(char) * G->arc_index);
-          copy_state(&t, &(potential_in->data), G);
-          num_new_ins++;
-          s_insert_tagged_data(&new_ins, t, num_new_ins, G);
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   num_new_ins + num_ins, new_edges);
+  struct PackedLayer *packed = malloc(sizeof(struct PackedLayer));
+  packed->count = count;
+  packed->key_len = key_len;
+  packed->states = NULL;
+  packed->deltas = deltas;
+  packed->tags = malloc(sizeof(int) * (count + 1));
+  packed->depth = from->depth + 1;
+  packed->refs = 1;
+  packed->parent = from;
+  from->refs++;
+  memcpy(packed->tags, tags, sizeof(int) * count);
+  return packed;
+}
+
+/**
+ * Sorts states by comp_state, carrying tags along
+ * @param states an array of states
+ * @param tags the tags of states
+ * @param count the number of states
+ * @param key_len the length of a state
+ */
+static void sort_states(State *states, int *tags, const int count,
+                        const int key_len) {
+  State *state_buf = malloc(sizeof(State) * (count + 1));
+  int *tag_buf = malloc(sizeof(int) * (count + 1));
+
+  // Bottom up merge sort, merging runs of width from states into the buffers
+  for (int width = 1; width < count; width *= 2) {
+    for (int lo = 0; lo < count; lo += 2 * width) {
+      const int mid = (lo + width < count) ? lo + width : count;
+      const int hi = (lo + 2 * width < count) ? lo + 2 * width : count;
+      int i = lo, j = mid, k = lo;
+      while (k < hi) {
+        if (j >= hi ||
+            (i < mid && memcmp(states[i], states[j], key_len) <= 0)) {
+          state_buf[k] = states[i];
+          tag_buf[k++] = tags[i++];
         } else {
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   node->tag + num_ins, new_edges);
+          state_buf[k] = states[j];
+          tag_buf[k++] = tags[j++];
         }
-        edge_count++;
       }
-
-      free_state_rbtree(&potential_ins);
-      s_free_iter(potential_iter);
-    }
-    s_free_iter(present_iter);
-
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
-    }
-    free_state_rbtree(&prev_outs);
-    prev_outs = new_outs;
-    new_outs = EMPTY_TREE;
-
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Full edge list:\n");
-      print_edges(edge_list);
-      (*print_ptr)("\n");
-      (*print_ptr)("Contracting edges from 0 to %d:\n", prev_in_number);
     }
+    memcpy(states, state_buf, sizeof(State) * count);
+    memcpy(tags, tag_buf, sizeof(int) * count);
+  }
 
-    new_edges = merge_sort_edges(new_edges);
-    edge_list = merge_edges(edge_list, new_edges);
+  free(state_buf);
+  free(tag_buf);
+}
 
-    special_homology(0, prev_in_number, &edge_list);
+/**
+ * Keeps the layers of a calculation under the memory budget of its context
+ * before the next layer is built. The rectangle cache counts toward the
+ * budget. Once the layers, edges and cache take half of the budget the
+ * calculation is compacted for good: the layer that is no longer needed is
+ * freed, the layers in use are packed, and the rectangle cache is no longer
+ * filled.
+ * @param C a complex
+ * @param dead the layer the next layer does not need, freed when compacting
+ * @param present the layer the next layer is built from
+ * @param prevs the layer excluded from the next layer
+ * @param live_edges the number of edges being kept
+ * @return nonzero if the layers and edges do not fit in the budget, in which
+ * case C->out_of_memory is set
+ */
+static int fit_memory(struct Complex *C, struct Layer *dead,
+                      struct Layer *present, struct Layer *prevs,
+                      const long live_edges) {
+  const double budget = C->ctx->max_memory;
+  const double cache = cache_bytes(C);
+  double bytes;
+
+  if (C->ctx->max_memory <= 0) {
+    return 0;
+  }
 
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(edge_list);
-      (*print_ptr)("\n");
+  bytes = layer_bytes(C, present) + layer_bytes(C, prevs) +
+          (double)live_edges * sizeof(EdgeNode_t);
+  // The next layer is often several times the size of the present one, so
+  // the layers are packed while there is still room to build it
+  if (!C->compact && bytes + layer_bytes(C, dead) + cache > 0.5 * budget) {
+    C->compact = 1;
+    if (C->ctx->verbosity >= QUIET) {
+      hfk_printf(C->ctx, "Packing the layers at %.1f MB of %.1f MB\n",
+                 (bytes + layer_bytes(C, dead) + cache) / 1e6, budget / 1e6);
     }
-    if ((edge_list == NULL) || (edge_list->start != 0)) {
-      // If there are no edges out of A_0 (sentinal is gone) after contraction
-      // init is null-homologous
-      ans = 1;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("No edges pointing out of A_0!\n");
-      }
-      free_state_rbtree(&new_ins);
-      free_state_rbtree(&new_outs);
-      free_state_rbtree(&prev_ins);
-      free_state_rbtree(&prev_outs);
-    } else if (edge_list->end <= prev_in_number) {
-      // If edges out of A_0 cannot be removed anymore (sentinal will never
-      // vanish) init is not null-homologous
-      ans = 0;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("There exist edges pointing from A_0 to B_%d! No future "
-                     "contractions will remove this edge!\n",
-                     current_pos - 1);
-      }
-      free_state_rbtree(&new_ins);
-      free_state_rbtree(&new_outs);
-      free_state_rbtree(&prev_ins);
-      free_state_rbtree(&prev_outs);
+  }
+  if (C->compact) {
+    free_layer(dead);
+    // A layer built from the other one is packed after it, as deltas from it
+    if (present->order == prevs->order + 1) {
+      pack_layer(C, prevs, NULL);
+      pack_layer(C, present, prevs);
     } else {
-      num_outs = num_outs + total_out;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos - 1, prev_in_number);
-        (*print_ptr)("Total number of states in A_i up to A_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_outs);
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_ins + total_in);
-        (*print_ptr)("Total number of edges  up to A_%d and B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, current_pos, edge_count);
-        (*print_ptr)("\n");
+      pack_layer(C, present, NULL);
+      pack_layer(C, prevs,
+                 (prevs->order == present->order + 1) ? present : NULL);
+    }
+    bytes = layer_bytes(C, present) + layer_bytes(C, prevs) +
+            retained_bytes(present, prevs) +
+            (double)live_edges * sizeof(EdgeNode_t);
+    // The states of a delta layer are rebuilt while the next layer is built
+    // from it
+    double rebuilt = 0;
+    for (int k = 0; k < 2; ++k) {
+      const struct PackedLayer *packed =
+          (0 == k) ? present->packed : prevs->packed;
+      if (NULL != packed && NULL == packed->states &&
+          (double)packed->count * C->K.arc_index > rebuilt) {
+        rebuilt = (double)packed->count * C->K.arc_index;
       }
     }
-    current_pos++;
+    bytes += rebuilt;
+  } else {
+    bytes += layer_bytes(C, dead);
   }
 
-  free_edge_list(edge_list);
-  return (ans);
+  C->memory_base = bytes;
+  if (bytes + cache > budget) {
+    C->out_of_memory = 1;
+    C->ctx->out_of_memory = 1;
+  }
+  return C->out_of_memory;
 }
 
-int null_homologous_lift(const LiftState init, const LiftGrid_t *const G) {
-  LiftStateRBTree new_ins, new_outs;
-  LiftStateRBTree prev_ins, prev_outs;
-  LiftStateRBTree potential_outs = EMPTY_LIFT_TREE,
-                  potential_ins = EMPTY_LIFT_TREE;
-  int ans, prev_in_number, total_in, total_out;
-  int edge_count = 0;
-  int num_ins = 0;
-  int num_outs = 0;
-  int num_new_ins = 0;
-  int num_new_outs = 0;
-  prev_outs = EMPTY_LIFT_TREE;
-  prev_ins = EMPTY_LIFT_TREE;
-  new_ins = EMPTY_LIFT_TREE;
-
-  LiftState s;
-  init_lift_state(&s, G);
-  copy_lift_state(&s, &init, G);
-
-  // Create sentinal edge from A_0
-  insert_tagged_data(&new_ins, s, 1, G);
-  EdgeList edge_list = prepend_edge(0, 1, NULL);
-
-  ans = 0;
-  int current_pos = 1;
-  while (new_ins != EMPTY_LIFT_TREE && !ans) {
-    num_new_outs = 0;
-    total_in = 0;
-    new_outs = EMPTY_LIFT_TREE;
-    EdgeList new_edges = NULL;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering A_%d:\n", current_pos);
-    }
-
-    // Build A_i by looking for states into B_(i-1) that are not in A_(i-1)
-    LiftTreeIter_t *present_iter;
-    for (present_iter = create_iter(new_ins); has_next(present_iter);) {
-      LiftStateRBTree present_in = get_next(present_iter);
-      total_in++;
-      potential_outs = new_lift_rectangles_into(prev_outs, present_in->data, G);
-
-      LiftTreeIter_t *potential_iter;
-      for (potential_iter = create_iter(potential_outs);
-           has_next(potential_iter);) {
-        LiftStateRBTree potential_out = get_next(potential_iter);
-        LiftStateRBTree node = find_node(&new_outs, potential_out->data, G);
-        if (EMPTY_LIFT_TREE == node) {
-          LiftState t;
-          init_lift_state(&t, G);
-          copy_lift_state(&t, &(potential_out->data), G);
-          num_new_outs++;
-          insert_tagged_data(&new_outs, t, num_new_outs, G);
-          new_edges = prepend_edge(num_new_outs + num_outs,
-                                   present_in->tag + num_ins, new_edges);
-        } else {
-          new_edges = prepend_edge(node->tag + num_outs,
-                                   present_in->tag + num_ins, new_edges);
-        }
-        edge_count++;
-      }
-
-      free_lift_state_rbtree(&potential_outs, G);
-      free_iter(potential_iter);
-    }
-    free_iter(present_iter);
-
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
-    }
-    free_lift_state_rbtree(&prev_ins, G);
-    prev_ins = new_ins;
-    num_ins = num_ins + total_in;
-    prev_in_number = num_ins;
-    num_new_ins = 0;
-    new_ins = EMPTY_LIFT_TREE;
-    total_out = 0;
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Gathering B_%d:\n", current_pos);
-    }
+/**
+ * Checks the memory budget while a single worker builds a layer
+ * @param C a complex
+ * @param dest the layer being built
+ * @param edges the number of edges found so far
+ * @return nonzero if the layer no longer fits in the budget, in which case
+ * C->out_of_memory is set
+ */
+static int over_memory(struct Complex *C, const struct Layer *dest,
+                       const int edges) {
+  if (C->ctx->max_memory <= 0) {
+    return 0;
+  }
+  const double bytes =
+      C->memory_base + layer_bytes(C, dest) + cache_bytes(C) +
+      (C->ctx->count_only ? 0 : (double)edges * sizeof(EdgeNode_t));
+  if (bytes > C->ctx->max_memory) {
+    C->out_of_memory = 1;
+    C->ctx->out_of_memory = 1;
+  }
+  return C->out_of_memory;
+}
 
-    // Build B_i by finding states out of A_i that are not in B_(i-1)
-    for (present_iter = create_iter(new_outs); has_next(present_iter);) {
-      LiftStateRBTree present_out = get_next(present_iter);
-      total_out++;
-      potential_ins =
-          new_lift_rectangles_out_of(prev_ins, present_out->data, G);
-
-      LiftTreeIter_t *potential_iter;
-      for (potential_iter = create_iter(potential_ins);
-           has_next(potential_iter);) {
-        LiftStateRBTree potential_in = get_next(potential_iter);
-        LiftStateRBTree node = find_node(&new_ins, potential_in->data, G);
-        if (EMPTY_LIFT_TREE == node) {
-          LiftState t;
-          init_lift_state(&t, G);
-          copy_lift_state(&t, &(potential_in->data), G);
-          num_new_ins++;
-          insert_tagged_data(&new_ins, t, num_new_ins, G);
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   num_new_ins + num_ins, new_edges);
-        } else {
-          new_edges = prepend_edge(present_out->tag + num_outs,
-                                   node->tag + num_ins, new_edges);
-        }
-        edge_count++;
-      }
+/**
+ * @param edge_list an EdgeList
+ * @return the number of edges in edge_list
+ */
+static long edge_list_length(const EdgeList edge_list) {
+  long length = 0;
+  for (EdgeList e = edge_list; NULL != e; e = e->nextEdge) {
+    length++;
+  }
+  return length;
+}
 
-      free_lift_state_rbtree(&potential_ins, G);
-      free_iter(potential_iter);
-    }
-    free_iter(present_iter);
+/**
+ * Fills in the report of a layer just built from the counters of the
+ * workers. Does nothing without telemetry.
+ * @param C a complex
+ * @param report the report
+ * @param side 'A' or 'B'
+ * @param pos the index of the layer
+ * @param present the number of states the layer was built from
+ * @param layer the layer
+ * @param edges the number of edges found while building layer
+ * @param start when building the layer started
+ */
+static void fill_report(const struct Complex *C, struct LayerReport *report,
+                        const char side, const int pos, const int present,
+                        const struct Layer *layer, const int edges,
+                        const struct timespec *start) {
+  if (NULL == C->ctx->telemetry) {
+    return;
+  }
+  report->expand_seconds = seconds_since(start);
+  report->side = side;
+  report->pos = pos;
+  report->present = present;
+  report->states = layer_size(layer);
+  report->edges = edges;
+  report->rectangles = 0;
+  report->cancelled = 0;
+  report->prev_hits = 0;
+  for (int i = 0; i < C->workers; ++i) {
+    report->rectangles += C->scratch[i].cand.rectangles;
+    report->cancelled += C->scratch[i].cand.cancelled;
+    report->prev_hits += C->scratch[i].cand.prev_hits;
+  }
+  report->edges_before = -1;
+  report->edges_after = -1;
+  report->contract_seconds = -1;
+}
 
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(new_edges);
-      (*print_ptr)("\n");
-    }
+/**
+ * Writes a report to the telemetry of the context as a JSON object on a line
+ * of its own. Fields that were not measured, such as the contraction of a
+ * layer that was not contracted, are null. Does nothing without telemetry.
+ * @param C a complex
+ * @param report a filled in report
+ */
+static void emit_report(const struct Complex *C,
+                        const struct LayerReport *report) {
+  char before[32] = "null", after[32] = "null", contract[32] = "null";
+  char rss[32] = "null";
 
-    free_lift_state_rbtree(&prev_outs, G);
-    prev_outs = new_outs;
-    new_outs = EMPTY_LIFT_TREE;
+  if (NULL == C->ctx->telemetry) {
+    return;
+  }
+  const long kb = resident_kb();
+  if (report->edges_before >= 0) {
+    snprintf(before, sizeof(before), "%ld", report->edges_before);
+  }
+  if (report->edges_after >= 0) {
+    snprintf(after, sizeof(after), "%ld", report->edges_after);
+  }
+  if (report->contract_seconds >= 0) {
+    snprintf(contract, sizeof(contract), "%.6f", report->contract_seconds);
+  }
+  if (kb >= 0) {
+    snprintf(rss, sizeof(rss), "%ld", kb);
+  }
+  // A single call, so the lines of calculations sharing the stream do not mix
+  fprintf(C->ctx->telemetry,
+          "{\"invariant\":\"%s\",\"layer\":\"%c_%d\",\"present\":%d,"
+          "\"states\":%d,\"edges\":%d,\"rectangles\":%ld,\"cancelled\":%ld,"
+          "\"prev_hits\":%ld,\"edges_before\":%s,\"edges_after\":%s,"
+          "\"expand_seconds\":%.6f,\"contract_seconds\":%s,\"rss_kb\":%s}\n",
+          C->ctx->label, report->side, report->pos, report->present,
+          report->states, report->edges, report->rectangles,
+          report->cancelled, report->prev_hits, before, after,
+          report->expand_seconds, contract, rss);
+}
 
-    new_edges = merge_sort_edges(new_edges);
-    edge_list = merge_edges(edge_list, new_edges);
+/**
+ * @param start a time read from CLOCK_MONOTONIC
+ * @return the seconds since start
+ */
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-    if (get_verbosity() >= VERBOSE) {
-      (*print_ptr)("Full edge list:\n");
-      print_edges(edge_list);
-      (*print_ptr)("\n");
-      (*print_ptr)("Contracting edges from 0 to %d:\n", prev_in_number);
-    }
+/**
+ * @return the resident memory of the process in kB, or -1 if it cannot be
+ * read
+ */
+static long resident_kb(void) {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  long size, resident = -1;
 
-    special_homology(0, prev_in_number, &edge_list);
-    if (get_verbosity() >= VERBOSE) {
-      print_edges(edge_list);
-      (*print_ptr)("\n");
-    }
-    if ((edge_list == NULL) || (edge_list->start != 0)) {
-      // If there are no edges out of A_0 (sentinal is gone) after contraction
-      // init is null-homologous
-      ans = 1;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("No edges pointing out of A_0!\n");
-      }
-      free_lift_state_rbtree(&new_ins, G);
-      free_lift_state_rbtree(&new_outs, G);
-      free_lift_state_rbtree(&prev_ins, G);
-      free_lift_state_rbtree(&prev_outs, G);
-    } else if (edge_list->end <= prev_in_number) {
-      // If edges out of A_0 cannot be removed anymore (sentinal will never
-      // vanish) init is not null-homologous
-      ans = 0;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("There exist edges pointing from A_0 to B_%d! No future "
-                     "contractions will remove this edge!\n",
-                     current_pos - 1);
-      }
-      free_lift_state_rbtree(&new_ins, G);
-      free_lift_state_rbtree(&new_outs, G);
-      free_lift_state_rbtree(&prev_ins, G);
-      free_lift_state_rbtree(&prev_outs, G);
-    } else {
-      num_outs = num_outs + total_out;
-      if (get_verbosity() >= VERBOSE) {
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos - 1, prev_in_number);
-        (*print_ptr)("Total number of states in A_i up to A_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_outs);
-        (*print_ptr)("Total number of states in B_i up to B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, num_ins + total_in);
-        (*print_ptr)("Total number of edges  up to A_%d and B_%d (before any "
-                     "contraction): %d \n",
-                     current_pos, current_pos, edge_count);
-        (*print_ptr)("\n");
-      }
-    }
-    current_pos++;
+  if (NULL == statm) {
+    return -1;
   }
-
-  free_edge_list(edge_list);
-  return (ans);
+  if (2 != fscanf(statm, "%ld %ld", &size, &resident)) {
+    resident = -1;
+  }
+  fclose(statm);
+  return (resident < 0) ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
 }
 
 /**
@@ -952,11 +2819,20 @@ void free_edge_list(const EdgeList e) {
  * @param init an int specifying the required start
  * @param final State to t
  * @param edge_list the EdgeList
+ * @param ctx checked before each contraction, may be NULL
+ * @return 0 once every such edge is contracted, or HFK_UNKNOWN if ctx was
+ * cancelled first
  */
-void special_homology(const int init, const int final, EdgeList *edge_list) {
+int special_homology(const int init, const int final, EdgeList *edge_list,
+                     const HFKContext_t *const ctx) {
+  PROFILE_START(start);
   EdgeList temp;
   temp = *edge_list;
   while ((*edge_list != NULL) && (temp != NULL)) {
+    if (NULL != ctx && is_context_cancelled(ctx)) {
+      PROFILE_STOP(PROFILE_CONTRACT, start);
+      return HFK_UNKNOWN;
+    }
     while ((temp != NULL) && (temp->start == init)) {
       temp = temp->nextEdge;
     }
@@ -968,6 +2844,8 @@ void special_homology(const int init, const int final, EdgeList *edge_list) {
       temp = *edge_list;
     }
   }
+  PROFILE_STOP(PROFILE_CONTRACT, start);
+  return 0;
 }
 
 /**
@@ -980,6 +2858,7 @@ void contract(const int start, const int end, EdgeList *edge_list) {
   VertexList children = NULL;
   VertexList affected_parents = NULL;
   EdgeList iter = *edge_list;
+  PROFILE_EVENT(PROFILE_CONTRACTIONS, 1);
 
   // Gather parents that will be affected and children that will be used
   while (iter != NULL) {
@@ -1163,27 +3042,17 @@ EdgeList append_ordered(const int a, const int b, const EdgeList edges) {
 }
 
 /**
- * Returns a StateList of states where a rectangle exists from incoming
- * that is not contained in prevs.
- * @param prevs Statelist containing previous states
- * @param incoming the source of rectangles used to generate statelist
+ * Calls fn with the two columns swapped by each rectangle leaving incoming
+ * @param incoming the source of the rectangles
  * @param G working grid
- * @return A statelist containing states reached from a rectangle leaving
- * incoming not contained in prevs.
+ * @param fn called as fn(col_a, col_b, data) for each rectangle
+ * @param data passed through to fn
  */
-StateRBTree new_rectangles_out_of(const StateRBTree prevs, const State incoming,
-                                  const Grid_t *const G) {
-  StateRBTree ans;
-  State temp_state = malloc(sizeof(char) * G->arc_index);
-  State temp;
+static void rectangles_out_of_internal(const State incoming,
+                                       const Grid_t *const G, rectangle_fn fn,
+                                       void *data) {
   int LL;
-  int w, h, i;
-  ans = EMPTY_TREE;
-  i = 0;
-  while (i < G->arc_index) {
-    temp_state[i] = incoming[i];
-    i++;
-  }
+  int w, h;
   LL = 0;
   while (LL < G->arc_index) {
     w = 1;
@@ -1192,19 +3061,7 @@ StateRBTree new_rectangles_out_of(const StateRBTree prevs, const State incoming,
     while (w < G->arc_index && h > 0) {
       if (mod(incoming[mod(LL + w, G->arc_index)] - incoming[LL],
               G->arc_index) <= h) {
-        temp_state[LL] = incoming[mod(LL + w, G->arc_index)];
-        temp_state[mod(LL + w, G->arc_index)] = incoming[LL];
-        if (!s_is_member(&prevs, temp_state, G)) {
-          if (s_is_member(&ans, temp_state, G)) {
-            s_delete_data(&ans, temp_state, G);
-          } else {
-            temp = swap_cols(LL, mod(LL + w, G->arc_index), incoming, G);
-            s_insert_data(&ans, temp, G);
-          }
-        }
-        temp_state[LL] = incoming[LL];
-        temp_state[mod(LL + w, G->arc_index)] =
-            incoming[mod(LL + w, G->arc_index)];
+        (*fn)(LL, mod(LL + w, G->arc_index), data);
         h = mod(incoming[mod(LL + w, G->arc_index)] - incoming[LL],
                 G->arc_index);
       }
@@ -1216,33 +3073,21 @@ StateRBTree new_rectangles_out_of(const StateRBTree prevs, const State incoming,
     }
     LL++;
   }
-
-  free(temp_state);
-  return ans;
 }
 
 /**
- * returns a StateRBTree containing those with a rectangle
- * pointing to the state incoming that do not overlap with prevs
- * @param incoming State that is the destination for generated rectangles
- * @param prevs StateRBTree of excluded states
+ * Calls fn with the two columns swapped by each rectangle pointing to
+ * incoming
+ * @param incoming the destination of the rectangles
  * @param G working grid
- * @return StateRBTree containing states with a rectangle to incoming.
+ * @param fn called as fn(col_a, col_b, data) for each rectangle
+ * @param data passed through to fn
  */
-StateRBTree new_rectangles_into(const StateRBTree prevs, const State incoming,
-                                const Grid_t *const G) {
-  StateRBTree ans;
-  State temp_state = malloc(sizeof(char) * G->arc_index);
-  State temp;
+static void rectangles_into_internal(const State incoming,
+                                     const Grid_t *const G, rectangle_fn fn,
+                                     void *data) {
   int LL;
   int w, h;
-  int i;
-  ans = EMPTY_TREE;
-  i = 0;
-  while (i < G->arc_index) {
-    temp_state[i] = incoming[i];
-    i++;
-  }
   LL = 0;
   while (LL < G->arc_index) {
     w = 1;
@@ -1251,19 +3096,7 @@ StateRBTree new_rectangles_into(const StateRBTree prevs, const State incoming,
     while (w < G->arc_index && h > 0) {
       if (mod_up(incoming[LL] - incoming[mod(LL + w, G->arc_index)],
                  G->arc_index) < h) {
-        temp_state[LL] = incoming[mod(LL + w, G->arc_index)];
-        temp_state[mod(LL + w, G->arc_index)] = incoming[LL];
-        if (!s_is_member(&prevs, temp_state, G)) {
-          if (s_is_member(&ans, temp_state, G)) {
-            s_delete_data(&ans, temp_state, G);
-          } else {
-            temp = swap_cols(LL, mod(LL + w, G->arc_index), incoming, G);
-            s_insert_data(&ans, temp, G);
-          }
-        }
-        temp_state[LL] = incoming[LL];
-        temp_state[mod(LL + w, G->arc_index)] =
-            incoming[mod(LL + w, G->arc_index)];
+        (*fn)(LL, mod(LL + w, G->arc_index), data);
         h = mod_up(incoming[LL] - incoming[mod(LL + w, G->arc_index)],
                    G->arc_index);
       }
@@ -1275,9 +3108,143 @@ StateRBTree new_rectangles_into(const StateRBTree prevs, const State incoming,
     }
     LL++;
   }
+}
 
-  free(temp_state);
-  return ans;
+/**
+ * Toggles the state obtained from c->incoming by swapping a and b in c->ans
+ * unless it is in c->prevs. Used as the rectangle_fn when collecting
+ * rectangles mod 2. If c->toggled is set the state is interned there from
+ * c->temp_state and its parity flipped in c->odd instead, so no copy of it
+ * is allocated.
+ * @param a an index into the state
+ * @param b an index into the state
+ * @param data a struct Candidates
+ */
+static void toggle_candidate(const int a, const int b, void *data) {
+  struct Candidates *c = data;
+  c->rectangles++;
+  PROFILE_EVENT(PROFILE_RECTANGLES, 1);
+  c->temp_state[a] = c->incoming[b];
+  c->temp_state[b] = c->incoming[a];
+  if (!s_is_member(&c->prevs, c->temp_state, c->G) &&
+      (NULL == c->prev_table ||
+       0 == state_table_id(c->prev_table, c->temp_state))) {
+    int added;
+    if (NULL != c->toggled) {
+      int id;
+      if (state_table_intern(c->toggled, c->temp_state, &id)) {
+        if (id > c->odd_capacity) {
+          c->odd_capacity = (0 == c->odd_capacity) ? 64 : 2 * c->odd_capacity;
+          c->odd = realloc(c->odd, sizeof(char) * c->odd_capacity);
+        }
+        c->odd[id - 1] = 0;
+      }
+      c->odd[id - 1] = !c->odd[id - 1];
+      added = c->odd[id - 1];
+    } else if (s_is_member(&c->ans, c->temp_state, c->G)) {
+      s_delete_data(&c->ans, c->temp_state, c->G);
+      added = 0;
+    } else {
+      s_insert_data(&c->ans, swap_cols(a, b, c->incoming, c->G), c->G);
+      added = 1;
+    }
+    if (added) {
+      c->size++;
+    } else {
+      c->size--;
+      c->cancelled++;
+      PROFILE_EVENT(PROFILE_CANCELLED, 1);
+    }
+  } else {
+    c->prev_hits++;
+  }
+  c->temp_state[a] = c->incoming[a];
+  c->temp_state[b] = c->incoming[b];
+}
+
+/**
+ * A rectangle_fn that remembers the rectangle in the scratch space so it can
+ * be added to the rectangle cache, then toggles it like toggle_candidate.
+ * @param a a position of the incoming state
+ * @param b a position of the incoming state
+ * @param data a struct Scratch
+ */
+static void record_candidate(const int a, const int b, void *data) {
+  struct Scratch *S = data;
+  if (S->pair_count == S->pair_capacity) {
+    S->pair_capacity = (0 == S->pair_capacity) ? 64 : 2 * S->pair_capacity;
+    S->pairs =
+        realloc(S->pairs, sizeof(unsigned short) * 2 * S->pair_capacity);
+  }
+  S->pairs[2 * S->pair_count] = (unsigned short)a;
+  S->pairs[2 * S->pair_count + 1] = (unsigned short)b;
+  S->pair_count++;
+  toggle_candidate(a, b, &S->cand);
+}
+
+/**
+ * Returns a StateList of states where a rectangle exists from incoming
+ * that is not contained in prevs.
+ * @param prevs Statelist containing previous states
+ * @param incoming the source of rectangles used to generate statelist
+ * @param G working grid
+ * @return A statelist containing states reached from a rectangle leaving
+ * incoming not contained in prevs.
+ */
+StateRBTree new_rectangles_out_of(const StateRBTree prevs, const State incoming,
+                                  const Grid_t *const G) {
+  struct Candidates c;
+  c.G = G;
+  c.incoming = incoming;
+  c.temp_state = malloc(sizeof(char) * G->arc_index);
+  c.prevs = prevs;
+  c.prev_table = NULL;
+  c.toggled = NULL;
+  c.ans = EMPTY_TREE;
+  c.size = 0;
+  c.rectangles = 0;
+  c.cancelled = 0;
+  c.prev_hits = 0;
+  copy_state(&c.temp_state, &incoming, G);
+  PROFILE_START(start);
+
+  rectangles_out_of_internal(incoming, G, toggle_candidate, &c);
+
+  PROFILE_STOP(PROFILE_ENUMERATE, start);
+  free(c.temp_state);
+  return c.ans;
+}
+
+/**
+ * returns a StateRBTree containing those with a rectangle
+ * pointing to the state incoming that do not overlap with prevs
+ * @param incoming State that is the destination for generated rectangles
+ * @param prevs StateRBTree of excluded states
+ * @param G working grid
+ * @return StateRBTree containing states with a rectangle to incoming.
+ */
+StateRBTree new_rectangles_into(const StateRBTree prevs, const State incoming,
+                                const Grid_t *const G) {
+  struct Candidates c;
+  c.G = G;
+  c.incoming = incoming;
+  c.temp_state = malloc(sizeof(char) * G->arc_index);
+  c.prevs = prevs;
+  c.prev_table = NULL;
+  c.toggled = NULL;
+  c.ans = EMPTY_TREE;
+  c.size = 0;
+  c.rectangles = 0;
+  c.cancelled = 0;
+  c.prev_hits = 0;
+  copy_state(&c.temp_state, &incoming, G);
+  PROFILE_START(start);
+
+  rectangles_into_internal(incoming, G, toggle_candidate, &c);
+
+  PROFILE_STOP(PROFILE_ENUMERATE, start);
+  free(c.temp_state);
+  return c.ans;
 }
 
 /**
@@ -1339,22 +3306,20 @@ StateList fixed_wt_rectangles_out_of(const int wt, const State incoming,
 }
 
 /**
- * Finds all lift states that are leaving the state incoming on G that are not
- * in prevs. Accounts for if the grid has been mirrored to calculate rectangles
- * in.
- * @param prevs a lift state list containing previously encountered states
+ * Calls fn with the two positions swapped by each rectangle leaving the lift
+ * state incoming on G. Positions index the flattened lift state, sheet by
+ * sheet. If G and incoming have been mirrored to find the rectangles into a
+ * state the positions are mirrored back.
  * @param incoming the lift state that rectangles will be leaving
  * @param G a grid
  * @param is_mirrored pass 1 if the grid has been mirrored, 0 otherwise
- * @return a lift state list containing lift states that can be reached from
- * incoming that are not in prevs
+ * @param fn called as fn(pos_a, pos_b, data) for each rectangle
+ * @param data passed through to fn
  */
-static LiftStateRBTree
-new_lift_rectangles_out_internal(const LiftStateRBTree prevs,
-                                 const LiftState incoming,
-                                 const LiftGrid_t *const G, int is_mirrored) {
-  LiftStateRBTree ans = EMPTY_LIFT_TREE;
-
+static void lift_rectangles_internal(const LiftState incoming,
+                                     const LiftGrid_t *const G,
+                                     const int is_mirrored, rectangle_fn fn,
+                                     void *data) {
   for (int start_sheet = 0; start_sheet < G->sheets; ++start_sheet) {
     for (int start_col = 0; start_col < G->arc_index; ++start_col) {
       int jumped_down = 0;
@@ -1414,30 +3379,10 @@ new_lift_rectangles_out_internal(const LiftStateRBTree prevs,
             check_col_gen = pmod(start_col + step + 1, G->arc_index);
             if (pmod(incoming[check_sheet_gen][check_col_gen] - 1,
                      G->arc_index) == height) {
-              LiftState new_state = NULL;
-              init_lift_state(&new_state, G);
-              copy_lift_state(&new_state, &incoming, G);
-              new_state[start_sheet][start_col] =
-                  incoming[check_sheet_gen][check_col_gen];
-              new_state[check_sheet_gen][check_col_gen] =
-                  incoming[start_sheet][start_col];
-              if (is_mirrored) {
-                mirror_lift_state(&new_state, G);
-              }
-
-              if (!is_member(&prevs, new_state, G)) {
-                if (!is_member(&ans, new_state, G)) {
-                  insert_data(&ans, new_state, G);
-                } else {
-                  LiftStateRBTree temp = find_node(&ans, new_state, G);
-                  delete_node(&ans, temp);
-                  free_lift_state(&(temp->data), G);
-                  free(temp);
-                  free_lift_state(&new_state, G);
-                }
-              } else {
-                free_lift_state(&new_state, G);
-              }
+              (*fn)(lift_position(start_sheet, start_col, G, is_mirrored),
+                    lift_position(check_sheet_gen, check_col_gen, G,
+                                  is_mirrored),
+                    data);
 
               height = pmod(height - 1, G->arc_index);
             }
@@ -1465,30 +3410,10 @@ new_lift_rectangles_out_internal(const LiftStateRBTree prevs,
           if (clear) {
             if (pmod(incoming[check_sheet_gen][check_col_gen] - 1,
                      G->arc_index) == height) {
-              LiftState new_state = NULL;
-              init_lift_state(&new_state, G);
-              copy_lift_state(&new_state, &incoming, G);
-              new_state[start_sheet][start_col] =
-                  incoming[check_sheet_gen][check_col_gen];
-              new_state[check_sheet_gen][check_col_gen] =
-                  incoming[start_sheet][start_col];
-              if (is_mirrored) {
-                mirror_lift_state(&new_state, G);
-              }
-
-              if (!is_member(&prevs, new_state, G)) {
-                if (!is_member(&ans, new_state, G)) {
-                  insert_data(&ans, new_state, G);
-                } else {
-                  LiftStateRBTree temp = find_node(&ans, new_state, G);
-                  delete_node(&ans, temp);
-                  free_lift_state(&(temp->data), G);
-                  free(temp);
-                  free_lift_state(&new_state, G);
-                }
-              } else {
-                free_lift_state(&new_state, G);
-              }
+              (*fn)(lift_position(start_sheet, start_col, G, is_mirrored),
+                    lift_position(check_sheet_gen, check_col_gen, G,
+                                  is_mirrored),
+                    data);
 
               height = pmod(height - 1, G->arc_index);
             }
@@ -1502,8 +3427,59 @@ new_lift_rectangles_out_internal(const LiftStateRBTree prevs,
       }
     }
   }
+}
 
-  return ans;
+
+/**
+ * Converts a sheet and column of a lift state into an index of the
+ * flattened lift state. A mirrored position is mapped back to the position
+ * it came from, see mirror_lift_state.
+ * @param sheet a sheet of G
+ * @param col a column of G
+ * @param G a lift grid
+ * @param is_mirrored pass 1 if the position is in a mirrored state
+ * @return the index of the position in the flattened lift state
+ */
+static int lift_position(const int sheet, const int col,
+                         const LiftGrid_t *const G, const int is_mirrored) {
+  if (is_mirrored) {
+    return (G->sheets - (sheet + 1)) * G->arc_index +
+           (0 == col ? 0 : G->arc_index - col);
+  }
+  return sheet * G->arc_index + col;
+}
+
+/**
+ * Toggles the lift state obtained from c->incoming by swapping the flattened
+ * positions a and b in c->ans unless it is in c->prevs.
+ * @param a an index into the flattened lift state
+ * @param b an index into the flattened lift state
+ * @param data a struct LiftCandidates
+ */
+static void toggle_lift_candidate(const int a, const int b, void *data) {
+  struct LiftCandidates *c = data;
+  const int n = c->G->arc_index;
+  LiftState new_state = NULL;
+  PROFILE_EVENT(PROFILE_RECTANGLES, 1);
+  init_lift_state(&new_state, c->G);
+  copy_lift_state(&new_state, &c->incoming, c->G);
+  new_state[a / n][a % n] = c->incoming[b / n][b % n];
+  new_state[b / n][b % n] = c->incoming[a / n][a % n];
+
+  if (!is_member(&c->prevs, new_state, c->G)) {
+    if (!is_member(&c->ans, new_state, c->G)) {
+      insert_data(&c->ans, new_state, c->G);
+    } else {
+      LiftStateRBTree temp = find_node(&c->ans, new_state, c->G);
+      delete_node(&c->ans, temp);
+      PROFILE_EVENT(PROFILE_CANCELLED, 1);
+      free_lift_state(&(temp->data), c->G);
+      free(temp);
+      free_lift_state(&new_state, c->G);
+    }
+  } else {
+    free_lift_state(&new_state, c->G);
+  }
 }
 
 /**
@@ -1517,7 +3493,17 @@ new_lift_rectangles_out_internal(const LiftStateRBTree prevs,
 LiftStateRBTree new_lift_rectangles_out_of(const LiftStateRBTree prevs,
                                            const LiftState incoming,
                                            const LiftGrid_t *const G) {
-  return new_lift_rectangles_out_internal(prevs, incoming, G, 0);
+  struct LiftCandidates c;
+  c.G = G;
+  c.incoming = incoming;
+  c.prevs = prevs;
+  c.ans = EMPTY_LIFT_TREE;
+  PROFILE_START(start);
+
+  lift_rectangles_internal(incoming, G, 0, toggle_lift_candidate, &c);
+
+  PROFILE_STOP(PROFILE_ENUMERATE, start);
+  return c.ans;
 }
 
 /**
@@ -1531,71 +3517,82 @@ LiftStateRBTree new_lift_rectangles_out_of(const LiftStateRBTree prevs,
 LiftStateRBTree new_lift_rectangles_into(const LiftStateRBTree prevs,
                                          const LiftState incoming,
                                          const LiftGrid_t *const G) {
+  PROFILE_START(start);
   LiftGrid_t *G_mirror = mirror_lift_grid(G);
   LiftState incoming_mirror;
   init_lift_state(&incoming_mirror, G);
   copy_lift_state(&incoming_mirror, &incoming, G);
   mirror_lift_state(&incoming_mirror, G);
-  LiftStateRBTree ans =
-      new_lift_rectangles_out_internal(prevs, incoming_mirror, G_mirror, 1);
+
+  struct LiftCandidates c;
+  c.G = G;
+  c.incoming = incoming;
+  c.prevs = prevs;
+  c.ans = EMPTY_LIFT_TREE;
+
+  lift_rectangles_internal(incoming_mirror, G_mirror, 1, toggle_lift_candidate,
+                           &c);
 
   free(G_mirror->Xs);
   free(G_mirror->Os);
   free(G_mirror);
   free_lift_state(&incoming_mirror, G);
 
-  return ans;
+  PROFILE_STOP(PROFILE_ENUMERATE, start);
+  return c.ans;
 }
 
 /**
  * Prints the permutation of state on the grid specified by
  * Xs and Os, as well as 2A=M=SL+1.
+ * @param ctx the context to print to
  * @param state a State
  * @param G working grid
  */
-void print_state(const State state, const Grid_t *const G) {
+void print_state(const HFKContext_t *const ctx, const State state,
+                 const Grid_t *const G) {
   int i, j;
   j = G->arc_index;
   i = 0;
-  (*print_ptr)("*---");
+  hfk_printf(ctx, "*---");
   while (i < G->arc_index - 1) {
-    (*print_ptr)("----");
+    hfk_printf(ctx, "----");
     i++;
   }
-  (*print_ptr)("*\n");
+  hfk_printf(ctx, "*\n");
   while (j > 0) {
     i = 0;
     while (i < G->arc_index) {
       if (G->Xs[i] == j) {
-        (*print_ptr)("| X ");
+        hfk_printf(ctx, "| X ");
       } else {
         if (G->Os[i] == j) {
-          (*print_ptr)("| O ");
+          hfk_printf(ctx, "| O ");
         } else {
-          (*print_ptr)("|   ");
+          hfk_printf(ctx, "|   ");
         }
       }
       i++;
     }
-    (*print_ptr)("|\n");
+    hfk_printf(ctx, "|\n");
     i = 0;
     while (i < G->arc_index) {
       if (state[i] == j) {
-        (*print_ptr)("@---");
+        hfk_printf(ctx, "@---");
       } else {
         if (i == 0 && j > 1) {
-          (*print_ptr)("|---");
+          hfk_printf(ctx, "|---");
         } else {
           if (j > 1) {
-            (*print_ptr)("+---");
+            hfk_printf(ctx, "+---");
           } else {
             if (i == 0) {
-              (*print_ptr)("*---");
+              hfk_printf(ctx, "*---");
             } else {
               if (i == 0) {
-                (*print_ptr)("----");
+                hfk_printf(ctx, "----");
               } else {
-                (*print_ptr)("----");
+                hfk_printf(ctx, "----");
               }
             }
           }
@@ -1604,368 +3601,395 @@ void print_state(const State state, const Grid_t *const G) {
       i++;
     }
     if (j > 1) {
-      (*print_ptr)("|\n");
+      hfk_printf(ctx, "|\n");
     } else {
-      (*print_ptr)("*\n");
+      hfk_printf(ctx, "*\n");
     }
     j--;
   }
-  (*print_ptr)("\n");
+  hfk_printf(ctx, "\n");
 }
 
 /**
  * Prints the permutation of state using one line notation
  * "{_,_,...}"
+ * @param ctx the context to print to
  * @param state a State
  * @param G working grid
  */
-void print_state_short(const State state, const Grid_t *const G) {
+void print_state_short(const HFKContext_t *const ctx, const State state,
+                       const Grid_t *const G) {
   int i;
   i = 0;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   while (i < G->arc_index - 1) {
-    (*print_ptr)("%d,", state[i]);
+    hfk_printf(ctx, "%d,", state[i]);
     i++;
   }
-  (*print_ptr)("%d}\n", state[G->arc_index - 1]);
+  hfk_printf(ctx, "%d}\n", state[G->arc_index - 1]);
 }
 
 /**
  * Calls print_state on the first sheet and print_state_short and the rest of
  * the sheets of the lift state
+ * @param ctx the context to print to
  * @param state a lift state
  * @param G a lift grid
  * @see print_state
  * @see print_state_short
  */
-void print_lift_state(const LiftState state, const LiftGrid_t *const G) {
+void print_lift_state(const HFKContext_t *const ctx, const LiftState state,
+                      const LiftGrid_t *const G) {
   Grid_t H;
   H.arc_index = G->arc_index;
   H.Xs = G->Xs;
   H.Os = G->Os;
 
-  (*print_ptr)("Sheet 0:\n");
-  print_state(state[0], &H);
+  hfk_printf(ctx, "Sheet 0:\n");
+  print_state(ctx, state[0], &H);
 
   for (int i = 1; i < G->sheets; ++i) {
-    (*print_ptr)("Sheet %d: ", i);
-    print_state_short(state[i], &H);
+    hfk_printf(ctx, "Sheet %d: ", i);
+    print_state_short(ctx, state[i], &H);
   }
 }
 
 /**
  * Prints the permutations of a lift state
+ * @param ctx the context to print to
  * @param state a lift state
  * @param G a grid
  * @see print_state_short
  */
-void print_lift_state_short(const LiftState state, const LiftGrid_t *const G) {
+void print_lift_state_short(const HFKContext_t *const ctx,
+                            const LiftState state, const LiftGrid_t *const G) {
   Grid_t G_p;
   G_p.arc_index = G->arc_index;
   G_p.Xs = G->Xs;
   G_p.Os = G->Os;
   for (int i = 0; i < G->sheets; ++i) {
-    (*print_ptr)("Sheet %d: ", i);
-    print_state_short(state[i], &G_p);
+    hfk_printf(ctx, "Sheet %d: ", i);
+    print_state_short(ctx, state[i], &G_p);
   }
 }
 
 /**
  * Prints each sheet of a lift state using print_state
+ * @param ctx the context to print to
  * @param state a lift state
  * @param G a lift grid
  * @see print_state
  */
-void print_lift_state_long(const LiftState state, const LiftGrid_t *const G) {
+void print_lift_state_long(const HFKContext_t *const ctx, const LiftState state,
+                           const LiftGrid_t *const G) {
   Grid_t H;
   H.arc_index = G->arc_index;
   H.Xs = G->Xs;
   H.Os = G->Os;
 
   for (int i = 0; i < G->sheets; ++i) {
-    (*print_ptr)("Sheet %d:\n", i);
-    print_state(state[i], &H);
+    hfk_printf(ctx, "Sheet %d:\n", i);
+    print_state(ctx, state[i], &H);
   }
 }
 
 /**
  * Prints states in the form "{<state>,...}" up
  * to the first 500,000 states.
+ * @param ctx the context to print to
  * @param states a StateList
  * @param G working grid
  * @see print_state_short
  */
-void print_states(const StateList states, const Grid_t *const G) {
+void print_states(const HFKContext_t *const ctx, const StateList states,
+                  const Grid_t *const G) {
   StateList temp;
   int c;
   temp = states;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   c = 0;
   while ((temp != NULL) && c < 500000) {
-    print_state_short(temp->data, G);
+    print_state_short(ctx, temp->data, G);
     temp = temp->nextState;
     if (temp != NULL) {
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
     }
     c++;
   }
   if (c == 500000) {
-    (*print_ptr)("...");
+    hfk_printf(ctx, "...");
   }
-  (*print_ptr)("}");
+  hfk_printf(ctx, "}");
 }
 
 /**
  * Prints states in the form "{<state>,...}" up to the first 500,000 states.
+ * @param ctx the context to print to
  * @param states a LiftStateList
  * @param G a lift grid
  * @see print_states
  */
-void print_lift_states(const LiftStateList states, const LiftGrid_t *const G) {
+void print_lift_states(const HFKContext_t *const ctx,
+                       const LiftStateList states, const LiftGrid_t *const G) {
   LiftStateList temp;
   int c;
   temp = states;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   c = 0;
   while ((temp != NULL) && c < 500000) {
-    print_lift_state_short(temp->data, G);
+    print_lift_state_short(ctx, temp->data, G);
     temp = temp->nextState;
     if (temp != NULL) {
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
     }
     c++;
   }
   if (c == 500000) {
-    (*print_ptr)("...");
+    hfk_printf(ctx, "...");
   }
-  (*print_ptr)("}");
+  hfk_printf(ctx, "}");
 }
 
 /**
  * Prints all states in the supplied tree using print_state_short
+ * @param ctx the context to print to
  * @param states a StateRBTree
  * @param G a grid
  * @see print_state_short
  */
-void print_states_tree(const StateRBTree states, const Grid_t *const G) {
+void print_states_tree(const HFKContext_t *const ctx, const StateRBTree states,
+                       const Grid_t *const G) {
   if (EMPTY_TREE == states) {
     return;
   }
-  print_state_short(states->data, G);
-  print_states_tree(states->left, G);
-  print_states_tree(states->right, G);
+  print_state_short(ctx, states->data, G);
+  print_states_tree(ctx, states->left, G);
+  print_states_tree(ctx, states->right, G);
 }
 
 /**
  * Prints all lift states in the supplied tree using print_lift_state_short
+ * @param ctx the context to print to
  * @param states a LiftStateRBTree
  * @param G a lift grid
  * @see print_lift_state_short
  */
-void print_states_lift_tree(const LiftStateRBTree states,
+void print_states_lift_tree(const HFKContext_t *const ctx,
+                            const LiftStateRBTree states,
                             const LiftGrid_t *const G) {
   if (EMPTY_LIFT_TREE == states) {
     return;
   }
-  print_lift_state(states->data, G);
-  print_states_lift_tree(states->left, G);
-  print_states_lift_tree(states->right, G);
+  print_lift_state(ctx, states->data, G);
+  print_states_lift_tree(ctx, states->left, G);
+  print_states_lift_tree(ctx, states->right, G);
 }
 
 /**
  * As print_states_tree but also prints the tags attatched to each state
+ * @param ctx the context to print to
  * @param states a StateRBTree
  * @param G a grid
  * @see print_states_tree
  */
-void print_states_tags(const StateRBTree states, const Grid_t *const G) {
+void print_states_tags(const HFKContext_t *const ctx, const StateRBTree states,
+                       const Grid_t *const G) {
   if (EMPTY_TREE == states) {
     return;
   }
-  (*print_ptr)("%d, ", states->tag);
-  print_state_short(states->data, G);
-  print_states_tags(states->left, G);
-  print_states_tags(states->right, G);
+  hfk_printf(ctx, "%d, ", states->tag);
+  print_state_short(ctx, states->data, G);
+  print_states_tags(ctx, states->left, G);
+  print_states_tags(ctx, states->right, G);
 }
 
 /**
  * As print_lift_states_tree but also prints the tags attatched to each lift
  * state
+ * @param ctx the context to print to
  * @param states a LiftStateRBTree
  * @param G a lift grid
  * @see print_lift_states_tree
  */
-void print_states_lift_tags(const LiftStateRBTree states,
+void print_states_lift_tags(const HFKContext_t *const ctx,
+                            const LiftStateRBTree states,
                             const LiftGrid_t *const G) {
   if (EMPTY_LIFT_TREE == states) {
     return;
   }
-  (*print_ptr)("%d, ", states->tag);
-  print_lift_state(states->data, G);
-  print_states_lift_tree(states->left, G);
-  print_states_lift_tree(states->right, G);
+  hfk_printf(ctx, "%d, ", states->tag);
+  print_lift_state(ctx, states->data, G);
+  print_states_lift_tree(ctx, states->left, G);
+  print_states_lift_tree(ctx, states->right, G);
 }
 
 /**
  * Prints each edge in the passed EdgeList
+ * @param ctx the context to print to
  * @param edge_list an EdgeList
  */
-void print_edges(const EdgeList edge_list) {
+void print_edges(const HFKContext_t *const ctx, const EdgeList edge_list) {
   EdgeList temp;
   temp = edge_list;
   while (temp != NULL) {
-    (*print_ptr)("[%d -> %d]\n", temp->start, temp->end);
+    hfk_printf(ctx, "[%d -> %d]\n", temp->start, temp->end);
     temp = (temp->nextEdge);
   }
 }
 
 /**
  * Print the first 80 edges edge_list on the same line
+ * @param ctx the context to print to
  * @param edge_list an EdgeList
  */
-void print_math_edges(const EdgeList edge_list) {
+void print_math_edges(const HFKContext_t *const ctx, const EdgeList edge_list) {
   EdgeList temp;
   int t;
   temp = edge_list;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   t = 0;
   while (temp != NULL) {
-    (*print_ptr)("[%d -> %d]", temp->start, temp->end);
+    hfk_printf(ctx, "[%d -> %d]", temp->start, temp->end);
     t++;
     if (t == 80) {
       temp = NULL;
-      (*print_ptr)("...");
+      hfk_printf(ctx, "...");
     } else {
       temp = (temp->nextEdge);
       if (temp != NULL)
-        (*print_ptr)(",");
+        hfk_printf(ctx, ",");
     }
   }
-  (*print_ptr)("}\n");
+  hfk_printf(ctx, "}\n");
 }
 
 /**
  * Prints the edges in a single line
+ * @param ctx the context to print to
  * @param edges an EdgeList
  */
-void print_math_edges_a(const EdgeList edges) {
+void print_math_edges_a(const HFKContext_t *const ctx, const EdgeList edges) {
   EdgeList temp;
   temp = edges;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   while (temp != NULL) {
-    (*print_ptr)("[%d->%d]", temp->start, temp->end);
+    hfk_printf(ctx, "[%d->%d]", temp->start, temp->end);
     temp = (temp->nextEdge);
     if (temp != NULL)
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
   }
-  (*print_ptr)("}");
+  hfk_printf(ctx, "}");
 }
 
 /**
  * Prints the vertices in VertexList on a single line
+ * @param ctx the context to print to
  * @param v_list a VertexList
  */
-void print_vertices(const VertexList v_list) {
+void print_vertices(const HFKContext_t *const ctx, const VertexList v_list) {
   VertexList temp;
   temp = v_list;
-  (*print_ptr)("{");
+  hfk_printf(ctx, "{");
   while (temp != NULL) {
-    (*print_ptr)("%d", (temp)->data);
+    hfk_printf(ctx, "%d", (temp)->data);
     temp = (temp)->nextVertex;
     if (temp != NULL)
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
   }
-  (*print_ptr)("}");
+  hfk_printf(ctx, "}");
 }
 
 /**
  * Prints the permutations of the Grid, ie the X O code inputed
  * by the user
+ * @param ctx the context to print to
  * @param G working grid
  */
-void print_grid_perm(const Grid_t *const G) {
+void print_grid_perm(const HFKContext_t *const ctx, const Grid_t *const G) {
   int i = 0;
-  (*print_ptr)("X = [");
+  hfk_printf(ctx, "X = [");
   while (i < G->arc_index) {
-    (*print_ptr)(" %d", G->Xs[i]);
+    hfk_printf(ctx, " %d", G->Xs[i]);
     if (i != G->arc_index - 1)
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
     i++;
   }
-  (*print_ptr)(" ]\nO = [");
+  hfk_printf(ctx, " ]\nO = [");
   i = 0;
   while (i < G->arc_index) {
-    (*print_ptr)(" %d", G->Os[i]);
+    hfk_printf(ctx, " %d", G->Os[i]);
     if (i != G->arc_index - 1)
-      (*print_ptr)(",");
+      hfk_printf(ctx, ",");
     i++;
   }
-  (*print_ptr)(" ]\n");
+  hfk_printf(ctx, " ]\n");
 }
 
 /**
  * Prints the grid without the grid state
+ * @param ctx the context to print to
  * @param G working grid
  */
-void print_grid(const Grid_t *const G) {
+void print_grid(const HFKContext_t *const ctx, const Grid_t *const G) {
   int i, j;
   j = G->arc_index;
   i = 0;
-  (*print_ptr)("*---");
+  hfk_printf(ctx, "*---");
   while (i < G->arc_index - 1) {
-    (*print_ptr)("----");
+    hfk_printf(ctx, "----");
     i++;
   }
-  (*print_ptr)("*\n");
+  hfk_printf(ctx, "*\n");
   while (j > 0) {
     i = 0;
     while (i < G->arc_index) {
       if (G->Xs[i] == j) {
-        (*print_ptr)("| X ");
+        hfk_printf(ctx, "| X ");
       } else {
         if (G->Os[i] == j) {
-          (*print_ptr)("| O ");
+          hfk_printf(ctx, "| O ");
         } else {
-          (*print_ptr)("|   ");
+          hfk_printf(ctx, "|   ");
         }
       }
       i++;
     }
-    (*print_ptr)("|\n");
+    hfk_printf(ctx, "|\n");
     i = 0;
     while (i < G->arc_index) {
       if (i == 0 && j > 1) {
-        (*print_ptr)("|---");
+        hfk_printf(ctx, "|---");
       } else {
         if (j > 1) {
-          (*print_ptr)("+---");
+          hfk_printf(ctx, "+---");
         } else {
           if (i == 0) {
-            (*print_ptr)("*---");
+            hfk_printf(ctx, "*---");
           } else {
-            (*print_ptr)("----");
+            hfk_printf(ctx, "----");
           }
         }
       }
       i++;
     }
     if (j > 1) {
-      (*print_ptr)("|\n");
+      hfk_printf(ctx, "|\n");
     } else {
-      (*print_ptr)("*\n");
+      hfk_printf(ctx, "*\n");
     }
     j--;
   }
-  (*print_ptr)("\n");
-  print_grid_perm(G);
-  (*print_ptr)("\n");
+  hfk_printf(ctx, "\n");
+  print_grid_perm(ctx, G);
+  hfk_printf(ctx, "\n");
 }
 
 /**
  * Prints Thurston Bennequin and rotation number of grid
+ * @param ctx the context to print to
  * @param G working grid
  */
-void print_tb_r(const Grid_t *const G) {
+void print_tb_r(const HFKContext_t *const ctx, const Grid_t *const G) {
   int writhe = 0;
   int up_down_cusps[2] = {0, 0};
   int tb;
@@ -1974,17 +3998,18 @@ void print_tb_r(const Grid_t *const G) {
   cusps(up_down_cusps, G);
   tb = writhe - .5 * (up_down_cusps[0] + up_down_cusps[1]);
   r = .5 * (up_down_cusps[1] - up_down_cusps[0]);
-  (*print_ptr)("tb = %d\n", tb);
-  (*print_ptr)("r = %d\n", r);
+  hfk_printf(ctx, "tb = %d\n", tb);
+  hfk_printf(ctx, "r = %d\n", r);
 }
 
 /**
  * Prints the Alexander and Maslov grading lines, which are calculated
  * from Thurston Bennequin and rotation number
+ * @param ctx the context to print to
  * @param G working grid
  * @param plus 1 if x^+ print, 0 if x^- print
  */
-void print_2AM(const Grid_t *const G, int plus) {
+void print_2AM(const HFKContext_t *const ctx, const Grid_t *const G, int plus) {
   int writhe = 0;
   int up_down_cusps[2] = {0, 0};
   int tb;
@@ -1994,7 +4019,7 @@ void print_2AM(const Grid_t *const G, int plus) {
   tb = writhe - .5 * (up_down_cusps[0] + up_down_cusps[1]);
   r = .5 * (up_down_cusps[1] - up_down_cusps[0]);
   if (plus == 1)
-    (*print_ptr)("2A(x^+) = M(x^+) = sl(x^+)+1 = %d\n\n", tb - r + 1);
+    hfk_printf(ctx, "2A(x^+) = M(x^+) = sl(x^+)+1 = %d\n\n", tb - r + 1);
   if (plus == 0)
-    (*print_ptr)("2A(x^-) = M(x^-) = %d\n\n", tb + r + 1);
+    hfk_printf(ctx, "2A(x^-) = M(x^-) = %d\n\n", tb + r + 1);
 }
@@ -20,22 +20,156 @@
 #include <limits.h>
 #include <math.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "hashset.h"
+#include "rectcache.h"
+#include "scheduler.h"
 #include "states.h"
+#include "statetable.h"
 
-typedef int (*printf_t)(const char *format, ...);
+typedef int (*vprintf_t)(void *, const char *format, va_list);
+typedef void *(*alloc_t)(void *, size_t);
+typedef void (*release_t)(void *, void *);
 
 #define SILENT 0
 #define QUIET 1
 #define VERBOSE 2
 
-void set_print_fn(printf_t);
-int get_verbosity(void);
-void set_verbosity(const int);
+#define HFK_UNKNOWN -1
+
+struct HFKStats {
+  long layers;
+  long states;
+  long rectangles;
+  long edges;
+  long cache_hits;
+  long cache_misses;
+};
+
+typedef struct HFKStats HFKStats_t;
+
+#define HFK_ESTIMATE_LAYERS 64
+
+/**
+ * The predicted size of a complex. Layer 0 is B_0 and layers 2i - 1 and 2i
+ * are A_i and B_i. At most samples states of each layer are kept to build
+ * the next one from, and the first exact layers, built from every state of
+ * the layers before them, are counted rather than estimated. Building a
+ * layer from a state took seconds_per_state on average while sampling, and
+ * peak_bytes is the most memory the states and edges kept by the
+ * calculation would take.
+ */
+struct HFKEstimate {
+  int samples;
+  unsigned int seed;
+  int layers;
+  int exact;
+  double states[HFK_ESTIMATE_LAYERS];
+  double edges[HFK_ESTIMATE_LAYERS];
+  double seconds_per_state;
+  double peak_bytes;
+};
+
+typedef struct HFKEstimate HFKEstimate_t;
+
+/**
+ * Everything a single calculation reads or writes besides its grid. Contexts
+ * share nothing but a rectangle cache, so calculations with different
+ * contexts may run at the same time on different threads.
+ */
+struct HFKContext {
+  /** SILENT, QUIET or VERBOSE */
+  int verbosity;
+  /** Prints the output of the calculation to print_data */
+  vprintf_t print;
+  void *print_data;
+  /**
+   * Allocate and free the working memory of the calculation. States and
+   * edges are always allocated with malloc, since they are freed by the list
+   * and tree functions.
+   */
+  alloc_t alloc;
+  release_t release;
+  void *alloc_data;
+  /** The number of workers building each layer */
+  int threads;
+  /** Nonzero to contract the edges of a layer while the next is built */
+  int pipelined;
+  /**
+   * Rectangles of the states seen so far, or NULL. The calculations of
+   * several invariants of the same grid may share one from any number of
+   * threads.
+   */
+  RectangleCache_t *rectangles;
+  /** Threads to reuse between calculations run one after another, or NULL */
+  Scheduler_t *scheduler;
+  HFKStats_t stats;
+  int cancel;
+  /**
+   * Above 0, a calculation that has not decided after building A_i and B_i
+   * for i up to max_layers returns HFK_UNKNOWN
+   */
+  int max_layers;
+  /**
+   * Once it passes the calculation stops as if it had been cancelled. With
+   * tv_sec equal to 0 it never passes.
+   */
+  struct timespec deadline;
+  /**
+   * When not NULL the layers are sampled instead of calculated, up to
+   * max_layers if it is set, and the calculation fills in estimate and
+   * returns HFK_UNKNOWN
+   */
+  HFKEstimate_t *estimate;
+  /**
+   * Nonzero to build the layers, up to max_layers if it is set, without
+   * keeping or contracting their edges. The size of each layer is printed as
+   * soon as it is built, the layers and edges are added to stats and the
+   * calculation returns HFK_UNKNOWN.
+   */
+  int count_only;
+  /**
+   * A file the layers being kept, the counters and the contracted edges are
+   * written to at the end of a layer once checkpoint_interval seconds have
+   * passed since it was last written, and the result once it is known; or
+   * NULL
+   */
+  const char *checkpoint;
+  double checkpoint_interval;
+  /** Nonzero to carry on from a checkpoint file holding the same complex */
+  int resume;
+  /**
+   * Above 0, the layers and edges of the calculation are kept under
+   * max_memory bytes. Once they take half of it the layers are packed, and
+   * if they still do not fit the calculation sets out_of_memory and returns
+   * HFK_UNKNOWN.
+   */
+  long max_memory;
+  int out_of_memory;
+  /**
+   * When not NULL a JSON object describing each layer is written to it on a
+   * line of its own, naming the calculation by label
+   */
+  FILE *telemetry;
+  const char *label;
+};
+
+typedef struct HFKContext HFKContext_t;
+
+void init_context(HFKContext_t *);
+void cancel_context(HFKContext_t *);
+void set_context_deadline(HFKContext_t *, const double);
+int is_context_cancelled(const HFKContext_t *const);
+int print_to_stream(void *, const char *, va_list);
+int hfk_printf(const HFKContext_t *const, const char *, ...);
+void *hfk_alloc(const HFKContext_t *const, const size_t);
+void hfk_free(const HFKContext_t *const, void *);
 
 int mod(const int, const int);
 int pmod(const int, const int);
@@ -45,9 +179,10 @@ int min(const int, const int);
 State swap_cols(const int, const int, const State, const Grid_t *const);
 StateList swap_cols_list(const int, const int, const State,
                          const Grid_t *const);
-int null_homologous_D0Q(const State, const Grid_t *const);
-int null_homologous_D1Q(const State, const Grid_t *const);
-int null_homologous_lift(const LiftState, const LiftGrid_t *const);
+int null_homologous_D0Q(const State, const Grid_t *const, HFKContext_t *);
+int null_homologous_D1Q(const State, const Grid_t *const, HFKContext_t *);
+int null_homologous_lift(const LiftState, const LiftGrid_t *const,
+                         HFKContext_t *);
 
 VertexList prepend_vertex(const int, const VertexList);
 void reverse_vertex_list(VertexList, VertexList *);
@@ -59,7 +194,8 @@ EdgeList merge_edges(EdgeList, EdgeList);
 EdgeList merge_sort_edges(EdgeList);
 void free_edge_list(const EdgeList);
 EdgeList append_ordered(const int, const int, const EdgeList);
-void special_homology(const int, const int, EdgeList *);
+int special_homology(const int, const int, EdgeList *,
+                     const HFKContext_t *const);
 void contract(const int, const int, EdgeList *);
 
 StateRBTree new_rectangles_out_of(const StateRBTree, const State,
@@ -74,25 +210,35 @@ LiftStateRBTree new_lift_rectangles_out_of(const LiftStateRBTree,
 LiftStateRBTree new_lift_rectangles_into(const LiftStateRBTree, const LiftState,
                                          const LiftGrid_t *const);
 
-void print_state(const State, const Grid_t *const);
-void print_lift_state(const LiftState, const LiftGrid_t *const);
-void print_state_short(const State, const Grid_t *const);
-void print_lift_state_short(const LiftState, const LiftGrid_t *const);
-void print_lift_state_long(const LiftState, const LiftGrid_t *const);
-void print_states(const StateList, const Grid_t *const);
-void print_lift_states(const LiftStateList, const LiftGrid_t *const);
-void print_states_tree(const StateRBTree, const Grid_t *const);
-void print_states_lift_tree(const LiftStateRBTree, const LiftGrid_t *const);
-void print_states_tags(const StateRBTree, const Grid_t *const);
-void print_states_lift_tree(const LiftStateRBTree, const LiftGrid_t *const);
-void print_edges(const EdgeList);
-void print_math_edges(const EdgeList);
-void print_math_edges_a(const EdgeList);
-void print_vertices(const VertexList);
-void print_grid_perm(const Grid_t *const G);
-void print_grid(const Grid_t *const G);
-void print_lift_grid(const Grid_t *const G);
-void print_tb_r(const Grid_t *const G);
-void print_2AM(const Grid_t *const G, int plus);
+void print_state(const HFKContext_t *const, const State, const Grid_t *const);
+void print_lift_state(const HFKContext_t *const, const LiftState,
+                      const LiftGrid_t *const);
+void print_state_short(const HFKContext_t *const, const State,
+                       const Grid_t *const);
+void print_lift_state_short(const HFKContext_t *const, const LiftState,
+                            const LiftGrid_t *const);
+void print_lift_state_long(const HFKContext_t *const, const LiftState,
+                           const LiftGrid_t *const);
+void print_states(const HFKContext_t *const, const StateList,
+                  const Grid_t *const);
+void print_lift_states(const HFKContext_t *const, const LiftStateList,
+                       const LiftGrid_t *const);
+void print_states_tree(const HFKContext_t *const, const StateRBTree,
+                       const Grid_t *const);
+void print_states_lift_tree(const HFKContext_t *const, const LiftStateRBTree,
+                            const LiftGrid_t *const);
+void print_states_tags(const HFKContext_t *const, const StateRBTree,
+                       const Grid_t *const);
+void print_states_lift_tree(const HFKContext_t *const, const LiftStateRBTree,
+                            const LiftGrid_t *const);
+void print_edges(const HFKContext_t *const, const EdgeList);
+void print_math_edges(const HFKContext_t *const, const EdgeList);
+void print_math_edges_a(const HFKContext_t *const, const EdgeList);
+void print_vertices(const HFKContext_t *const, const VertexList);
+void print_grid_perm(const HFKContext_t *const, const Grid_t *const G);
+void print_grid(const HFKContext_t *const, const Grid_t *const G);
+void print_lift_grid(const HFKContext_t *const, const Grid_t *const G);
+void print_tb_r(const HFKContext_t *const, const Grid_t *const G);
+void print_2AM(const HFKContext_t *const, const Grid_t *const G, int plus);
 
 #endif
@@ -0,0 +1,262 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define ALLOCTRACK_IMPLEMENTATION
+#include "alloctrack.h"
+
+#ifdef HFK_TRACK_ALLOC
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define usable_size(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define usable_size(p) malloc_usable_size(p)
+#endif
+
+#define PRINTED_SITES 20
+
+static AllocSite_t *sites = NULL;
+static AllocTotals_t totals;
+
+static void count_allocation(void *, const size_t, AllocSite_t *);
+static void count_free(void *);
+#endif
+
+/**
+ * As malloc, counting the allocation against site
+ * @param size the bytes to allocate
+ * @param site the call site
+ * @return the memory, or NULL
+ */
+void *track_malloc(const size_t size, AllocSite_t *site) {
+  void *p = malloc(size);
+#ifdef HFK_TRACK_ALLOC
+  count_allocation(p, size, site);
+#else
+  (void)site;
+#endif
+  return p;
+}
+
+/**
+ * As calloc, counting the allocation against site
+ * @param count the number of elements
+ * @param size the bytes of each
+ * @param site the call site
+ * @return the zeroed memory, or NULL
+ */
+void *track_calloc(const size_t count, const size_t size, AllocSite_t *site) {
+  void *p = calloc(count, size);
+#ifdef HFK_TRACK_ALLOC
+  count_allocation(p, count * size, site);
+#else
+  (void)site;
+#endif
+  return p;
+}
+
+/**
+ * As realloc, counting the allocation against site
+ * @param p memory to resize, or NULL
+ * @param size the bytes wanted
+ * @param site the call site
+ * @return the resized memory, or NULL in which case p is untouched
+ */
+void *track_realloc(void *p, const size_t size, AllocSite_t *site) {
+#ifdef HFK_TRACK_ALLOC
+  const long long old = (NULL == p) ? 0 : (long long)usable_size(p);
+  void *q = realloc(p, size);
+  if (NULL != q) {
+    __atomic_sub_fetch(&totals.current, old, __ATOMIC_RELAXED);
+    count_allocation(q, size, site);
+  }
+  return q;
+#else
+  (void)site;
+  return realloc(p, size);
+#endif
+}
+
+/**
+ * As strdup, counting the allocation against site
+ * @param s a string
+ * @param site the call site
+ * @return a copy of s, or NULL
+ */
+char *track_strdup(const char *s, AllocSite_t *site) {
+  char *p = strdup(s);
+#ifdef HFK_TRACK_ALLOC
+  count_allocation(p, strlen(s) + 1, site);
+#else
+  (void)site;
+#endif
+  return p;
+}
+
+/**
+ * As free. Memory allocated inside the C library, by getline for instance,
+ * is counted as freed without having been counted as allocated.
+ * @param p memory to free, or NULL
+ */
+void track_free(void *p) {
+#ifdef HFK_TRACK_ALLOC
+  count_free(p);
+#endif
+  free(p);
+}
+
+/**
+ * Copies the totals counted so far
+ * @param dest destination for the totals
+ * @return 1 if built with HFK_TRACK_ALLOC, 0 otherwise in which case nothing
+ * is copied
+ */
+int get_allocations(AllocTotals_t *dest) {
+#ifdef HFK_TRACK_ALLOC
+  dest->allocations =
+      __atomic_load_n(&totals.allocations, __ATOMIC_RELAXED);
+  dest->frees = __atomic_load_n(&totals.frees, __ATOMIC_RELAXED);
+  dest->bytes = __atomic_load_n(&totals.bytes, __ATOMIC_RELAXED);
+  dest->current = __atomic_load_n(&totals.current, __ATOMIC_RELAXED);
+  dest->peak = __atomic_load_n(&totals.peak, __ATOMIC_RELAXED);
+  return 1;
+#else
+  (void)dest;
+  return 0;
+#endif
+}
+
+/**
+ * @return the call sites that have allocated, most recently first used
+ * first, or NULL unless built with HFK_TRACK_ALLOC
+ */
+const AllocSite_t *get_allocation_sites(void) {
+#ifdef HFK_TRACK_ALLOC
+  return __atomic_load_n(&sites, __ATOMIC_ACQUIRE);
+#else
+  return NULL;
+#endif
+}
+
+/**
+ * Zeroes the counts of the sites and the totals, and starts the peak again
+ * from the memory currently allocated. Not to be called while a calculation
+ * is running.
+ */
+void reset_allocations(void) {
+#ifdef HFK_TRACK_ALLOC
+  for (AllocSite_t *site = sites; NULL != site; site = site->next) {
+    site->calls = 0;
+    site->bytes = 0;
+  }
+  totals.allocations = 0;
+  totals.frees = 0;
+  totals.bytes = 0;
+  totals.peak = totals.current;
+#endif
+}
+
+/**
+ * Prints the totals and the sites that allocated most often. Prints nothing
+ * unless built with HFK_TRACK_ALLOC.
+ * @param out the stream to print to
+ */
+void print_allocations(FILE *out) {
+#ifdef HFK_TRACK_ALLOC
+  const AllocSite_t *printed[PRINTED_SITES];
+  int count = 0;
+  AllocTotals_t t;
+
+  get_allocations(&t);
+  fprintf(out, "%llu allocations of %llu bytes, %llu frees, peak %lld bytes, "
+               "%lld bytes still allocated\n",
+          t.allocations, t.bytes, t.frees, t.peak, t.current);
+
+  // Insertion sort of the busiest sites, there are only a few hundred
+  for (const AllocSite_t *site = get_allocation_sites(); NULL != site;
+       site = site->next) {
+    int i = (count < PRINTED_SITES) ? count++ : PRINTED_SITES;
+    while (i > 0 && printed[i - 1]->calls < site->calls) {
+      if (i < PRINTED_SITES) {
+        printed[i] = printed[i - 1];
+      }
+      --i;
+    }
+    if (i < PRINTED_SITES) {
+      printed[i] = site;
+    }
+  }
+
+  fprintf(out, "%-32s %14s %16s\n", "site", "calls", "bytes");
+  for (int i = 0; i < count; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s:%d", printed[i]->file, printed[i]->line);
+    fprintf(out, "%-32s %14llu %16llu\n", name, printed[i]->calls,
+            printed[i]->bytes);
+  }
+#else
+  (void)out;
+#endif
+}
+
+#ifdef HFK_TRACK_ALLOC
+/**
+ * Counts an allocation against site and the totals, adding site to the list
+ * of sites the first time
+ * @param p the memory allocated, or NULL if the allocation failed
+ * @param size the bytes asked for
+ * @param site the call site
+ */
+static void count_allocation(void *p, const size_t size, AllocSite_t *site) {
+  if (NULL == p) {
+    return;
+  }
+  if (0 == __atomic_exchange_n(&site->listed, 1, __ATOMIC_ACQ_REL)) {
+    AllocSite_t *head = __atomic_load_n(&sites, __ATOMIC_ACQUIRE);
+    do {
+      site->next = head;
+    } while (!__atomic_compare_exchange_n(&sites, &head, site, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  }
+  __atomic_add_fetch(&site->calls, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&site->bytes, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&totals.allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&totals.bytes, size, __ATOMIC_RELAXED);
+
+  // The usable size is what free will subtract again
+  const long long current = __atomic_add_fetch(
+      &totals.current, (long long)usable_size(p), __ATOMIC_RELAXED);
+  long long peak = __atomic_load_n(&totals.peak, __ATOMIC_RELAXED);
+  while (current > peak &&
+         !__atomic_compare_exchange_n(&totals.peak, &peak, current, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/**
+ * Counts a free in the totals
+ * @param p the memory about to be freed, or NULL
+ */
+static void count_free(void *p) {
+  if (NULL == p) {
+    return;
+  }
+  __atomic_add_fetch(&totals.frees, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&totals.current, (long long)usable_size(p),
+                     __ATOMIC_RELAXED);
+}
+#endif
@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A place in the source that allocates, counted when built with
+ * HFK_TRACK_ALLOC. Each call site of malloc, calloc, realloc and strdup has
+ * its own, which is added to the list of sites the first time it is used.
+ */
+struct AllocSite {
+  const char *file;
+  int line;
+  int listed;
+  unsigned long long calls;
+  unsigned long long bytes;
+  struct AllocSite *next;
+};
+
+typedef struct AllocSite AllocSite_t;
+
+struct AllocTotals {
+  unsigned long long allocations;
+  unsigned long long frees;
+  unsigned long long bytes;
+  long long current;
+  long long peak;
+};
+
+typedef struct AllocTotals AllocTotals_t;
+
+void *track_malloc(const size_t, AllocSite_t *);
+void *track_calloc(const size_t, const size_t, AllocSite_t *);
+void *track_realloc(void *, const size_t, AllocSite_t *);
+char *track_strdup(const char *, AllocSite_t *);
+void track_free(void *);
+
+int get_allocations(AllocTotals_t *);
+const AllocSite_t *get_allocation_sites(void);
+void reset_allocations(void);
+void print_allocations(FILE *);
+
+#if defined(HFK_TRACK_ALLOC) && !defined(ALLOCTRACK_IMPLEMENTATION)
+
+#define ALLOC_SITE(call)                                                       \
+  ({                                                                           \
+    static AllocSite_t alloc_site = {__FILE__, __LINE__, 0, 0, 0, NULL};       \
+    call;                                                                      \
+  })
+#define malloc(size) ALLOC_SITE(track_malloc((size), &alloc_site))
+#define calloc(count, size)                                                    \
+  ALLOC_SITE(track_calloc((count), (size), &alloc_site))
+#define realloc(p, size) ALLOC_SITE(track_realloc((p), (size), &alloc_site))
+#define strdup(s) ALLOC_SITE(track_strdup((s), &alloc_site))
+#define free(p) track_free(p)
+
+#endif
+
+#endif
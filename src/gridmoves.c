@@ -0,0 +1,286 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gridmoves.h"
+
+static int interleaved(int, int, int, int);
+static void tb_r(int *, int *, const Grid_t *const);
+static void destabilize(Grid_t *, const int, const int);
+
+/**
+ * Swaps columns c and c + 1 of G if their vertical segments do not
+ * interleave, which is a commutation move and so a Legendrian isotopy.
+ * @param G a grid
+ * @param c a column, at most arc_index - 2
+ * @return 1 if the columns were swapped, 0 otherwise
+ */
+int commute_columns(Grid_t *G, const int c) {
+  if (interleaved(G->Xs[c], G->Os[c], G->Xs[c + 1], G->Os[c + 1])) {
+    return 0;
+  }
+
+  char temp = G->Xs[c];
+  G->Xs[c] = G->Xs[c + 1];
+  G->Xs[c + 1] = temp;
+  temp = G->Os[c];
+  G->Os[c] = G->Os[c + 1];
+  G->Os[c + 1] = temp;
+  return 1;
+}
+
+/**
+ * Swaps rows r and r + 1 of G if their horizontal segments do not
+ * interleave, which is a commutation move and so a Legendrian isotopy.
+ * @param G a grid
+ * @param r a row, from 1 to arc_index - 1
+ * @return 1 if the rows were swapped, 0 otherwise
+ */
+int commute_rows(Grid_t *G, const int r) {
+  int ends[4] = {0, 0, 0, 0};
+
+  for (int i = 0; i < G->arc_index; ++i) {
+    if (G->Xs[i] == r) {
+      ends[0] = i;
+    } else if (G->Xs[i] == r + 1) {
+      ends[2] = i;
+    }
+    if (G->Os[i] == r) {
+      ends[1] = i;
+    } else if (G->Os[i] == r + 1) {
+      ends[3] = i;
+    }
+  }
+  if (interleaved(ends[0], ends[1], ends[2], ends[3])) {
+    return 0;
+  }
+
+  for (int i = 0; i < G->arc_index; ++i) {
+    if (G->Xs[i] == r || G->Xs[i] == r + 1) {
+      G->Xs[i] = (char)(2 * r + 1 - G->Xs[i]);
+    }
+    if (G->Os[i] == r || G->Os[i] == r + 1) {
+      G->Os[i] = (char)(2 * r + 1 - G->Os[i]);
+    }
+  }
+  return 1;
+}
+
+/**
+ * Looks for a destabilization of G that keeps its Thurston-Bennequin and
+ * rotation numbers, and applies the first one found. A destabilization
+ * removes a column whose X and O are in rows adjacent on the torus when the
+ * 2x2 square they span with a neighbouring column holds a third marking.
+ * Of the four kinds of destabilization the two that keep tb and r are
+ * Legendrian isotopies; the other two undo a Legendrian stabilization. The
+ * x^- and x^+ states of the two grids correspond, so the invariants may be
+ * calculated on the smaller grid.
+ * @param G a grid, shrunk in place
+ * @return 1 if G was destabilized, 0 otherwise
+ */
+int legendrian_destabilize(Grid_t *G) {
+  const int n = G->arc_index;
+  int tb, r;
+
+  if (n <= 2) {
+    return 0;
+  }
+  tb_r(&tb, &r, G);
+
+  for (int c = 0; c < n; ++c) {
+    const int a = G->Xs[c], b = G->Os[c];
+    if (1 != abs(a - b) && n - 1 != abs(a - b)) {
+      continue;
+    }
+
+    // The columns of the O in row a and of the X in row b
+    int p = 0, q = 0;
+    for (int i = 0; i < n; ++i) {
+      if (G->Os[i] == a) {
+        p = i;
+      }
+      if (G->Xs[i] == b) {
+        q = i;
+      }
+    }
+    if (p == q || (p != (c + 1) % n && p != (c + n - 1) % n &&
+                   q != (c + 1) % n && q != (c + n - 1) % n)) {
+      continue;
+    }
+
+    Grid_t H;
+    H.Xs = malloc(sizeof(char) * n);
+    H.Os = malloc(sizeof(char) * n);
+    H.arc_index = n;
+    memcpy(H.Xs, G->Xs, n);
+    memcpy(H.Os, G->Os, n);
+    destabilize(&H, c, b);
+
+    int new_tb, new_r;
+    tb_r(&new_tb, &new_r, &H);
+    if (new_tb == tb && new_r == r) {
+      memcpy(G->Xs, H.Xs, n - 1);
+      memcpy(G->Os, H.Os, n - 1);
+      G->arc_index = n - 1;
+    }
+    free(H.Xs);
+    free(H.Os);
+    if (G->arc_index < n) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Stabilizes G at the X of column c, the inverse of a destabilization. A new
+ * column is put next to column c and a new row next to the row of its X, the
+ * X moves into the new row and the new column takes an X in the old row and
+ * an O in the new one, so the 2x2 square they span holds three markings.
+ * Which side the column and the row are put on gives the four kinds of
+ * stabilization, two of which keep tb and r and are Legendrian isotopies.
+ * @param G a grid whose Xs and Os have room for arc_index + 1 entries,
+ * grown in place
+ * @param c a column
+ * @param kind 0 to 3, bit 0 puts the new column to the right of column c and
+ * bit 1 puts the new row above the row of the X
+ */
+void stabilize(Grid_t *G, const int c, const int kind) {
+  const int n = G->arc_index;
+  const int a = G->Xs[c];
+  const int col = c + (kind & 1);
+  const int row = a + ((kind >> 1) & 1);
+
+  for (int i = 0; i < n; ++i) {
+    G->Xs[i] = (char)((G->Xs[i] >= row) ? G->Xs[i] + 1 : G->Xs[i]);
+    G->Os[i] = (char)((G->Os[i] >= row) ? G->Os[i] + 1 : G->Os[i]);
+  }
+  for (int i = n; i > col; --i) {
+    G->Xs[i] = G->Xs[i - 1];
+    G->Os[i] = G->Os[i - 1];
+  }
+  G->arc_index = n + 1;
+
+  G->Xs[(col == c) ? c + 1 : c] = (char)row;
+  G->Xs[col] = (char)((a >= row) ? a + 1 : a);
+  G->Os[col] = (char)row;
+}
+
+/**
+ * Shrinks G by Legendrian destabilizations for as long as one can be found
+ * directly or after a single commutation of columns or rows. Every move is a
+ * Legendrian isotopy taking x^- and x^+ of one grid to x^- and x^+ of the
+ * next, so the invariants of the result are those of G.
+ * @param G a grid, simplified in place
+ * @param moves filled with the number of moves of each kind applied
+ */
+void simplify_grid(Grid_t *G, Simplification_t *moves) {
+  int tb, r;
+  tb_r(&tb, &r, G);
+
+  Grid_t H;
+  H.Xs = malloc(sizeof(char) * G->arc_index);
+  H.Os = malloc(sizeof(char) * G->arc_index);
+
+  moves->commutations = 0;
+  moves->destabilizations = 0;
+  for (;;) {
+    if (legendrian_destabilize(G)) {
+      moves->destabilizations++;
+      continue;
+    }
+
+    // Try each commutation on a copy and keep it if it allows a
+    // destabilization
+    int found = 0;
+    for (int k = 0; k < 2 * (G->arc_index - 1) && !found; ++k) {
+      const int n = G->arc_index;
+      memcpy(H.Xs, G->Xs, n);
+      memcpy(H.Os, G->Os, n);
+      H.arc_index = n;
+      if ((k < n - 1) ? commute_columns(&H, k) : commute_rows(&H, k - n + 2)) {
+        found = legendrian_destabilize(&H);
+      }
+    }
+    if (!found) {
+      break;
+    }
+    memcpy(G->Xs, H.Xs, H.arc_index);
+    memcpy(G->Os, H.Os, H.arc_index);
+    G->arc_index = H.arc_index;
+    moves->commutations++;
+    moves->destabilizations++;
+  }
+
+  free(H.Xs);
+  free(H.Os);
+
+  int new_tb, new_r;
+  tb_r(&new_tb, &new_r, G);
+  assert(new_tb == tb && new_r == r);
+}
+
+/**
+ * @return 1 if the segments from a to b and from c to d interleave, that is
+ * they are neither disjoint nor strictly nested. Segments sharing an endpoint
+ * interleave: swapping them is not a commutation and may change tb.
+ */
+static int interleaved(int a, int b, int c, int d) {
+  const int lo = (a < b) ? a : b, hi = (a < b) ? b : a;
+  const int other_lo = (c < d) ? c : d, other_hi = (c < d) ? d : c;
+  if (hi < other_lo || other_hi < lo) {
+    return 0;
+  }
+  return !(lo < other_lo && other_hi < hi) &&
+         !(other_lo < lo && hi < other_hi);
+}
+
+/**
+ * Calculates the Thurston-Bennequin and rotation numbers of G
+ * @param tb destination for the Thurston-Bennequin number
+ * @param r destination for the rotation number
+ * @param G a grid
+ */
+static void tb_r(int *tb, int *r, const Grid_t *const G) {
+  int up_down_cusps[2] = {0, 0};
+  cusps(up_down_cusps, G);
+  *tb = get_writhe(G) - (up_down_cusps[0] + up_down_cusps[1]) / 2;
+  *r = (up_down_cusps[1] - up_down_cusps[0]) / 2;
+}
+
+/**
+ * Removes column c of G and merges row b into the row adjacent to it that
+ * holds the X of column c
+ * @param G a grid
+ * @param c a column whose X and O are in adjacent rows
+ * @param b the row of the O of column c
+ */
+static void destabilize(Grid_t *G, const int c, const int b) {
+  const int a = G->Xs[c];
+  const int n = G->arc_index;
+
+  for (int i = c; i < n - 1; ++i) {
+    G->Xs[i] = G->Xs[i + 1];
+    G->Os[i] = G->Os[i + 1];
+  }
+  G->arc_index = n - 1;
+
+  for (int i = 0; i < n - 1; ++i) {
+    int x = (G->Xs[i] == b) ? a : G->Xs[i];
+    int o = (G->Os[i] == b) ? a : G->Os[i];
+    G->Xs[i] = (char)((x > b) ? x - 1 : x);
+    G->Os[i] = (char)((o > b) ? o - 1 : o);
+  }
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRIDMOVES_H
+#define GRIDMOVES_H
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "states.h"
+
+struct Simplification {
+  int commutations;
+  int destabilizations;
+};
+
+typedef struct Simplification Simplification_t;
+
+int commute_columns(Grid_t *, const int);
+int commute_rows(Grid_t *, const int);
+int legendrian_destabilize(Grid_t *);
+void stabilize(Grid_t *, const int, const int);
+void simplify_grid(Grid_t *, Simplification_t *);
+
+#endif
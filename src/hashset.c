@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hashset.h"
+
+/**
+ * Creates an empty set able to hold at least expected states of length
+ * key_len. The set does not grow, so expected must bound the number of
+ * states that will be inserted.
+ * @param expected the maximum number of states
+ * @param key_len the number of chars in each state
+ * @return a pointer to the set
+ */
+StateHashSet_t *create_hash_set(const long expected, const int key_len) {
+  StateHashSet_t *set = malloc(sizeof(StateHashSet_t));
+  set->capacity = 16;
+  while (set->capacity < 2 * expected) {
+    set->capacity *= 2;
+  }
+  set->keys = calloc(set->capacity, sizeof(State));
+  set->tags = calloc(set->capacity, sizeof(int));
+  set->key_len = key_len;
+  set->count = 0;
+  return set;
+}
+
+/**
+ * Adds s to set unless an equal state is already present. May be called
+ * from several threads at once: a slot is claimed by swapping its key in
+ * with a compare and swap and the tags 1, 2, ... are handed out with an
+ * atomic increment. A thread that finds s already present waits for the
+ * tag of the slot to be published.
+ * @param set a StateHashSet
+ * @param s a state, owned by set if it is added
+ * @param tag destination for the tag of s in set
+ * @return 1 if s was added and 0 if an equal state was already present
+ */
+int hash_set_insert(StateHashSet_t *set, const State s, int *tag) {
+  const long mask = set->capacity - 1;
+  long i = (long)(hash_state(s, set->key_len) & mask);
+
+  for (;;) {
+    State key = __atomic_load_n(&set->keys[i], __ATOMIC_ACQUIRE);
+    if (NULL == key) {
+      if (__atomic_compare_exchange_n(&set->keys[i], &key, s, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        *tag = __atomic_add_fetch(&set->count, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&set->tags[i], *tag, __ATOMIC_RELEASE);
+        return 1;
+      }
+    }
+    if (0 == memcmp(key, s, set->key_len)) {
+      while (0 == (*tag = __atomic_load_n(&set->tags[i], __ATOMIC_ACQUIRE))) {
+      }
+      return 0;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+/**
+ * Looks up the tag of s in set
+ * @param set a StateHashSet
+ * @param s a state
+ * @return the tag of s, or 0 if s is not in set
+ */
+int hash_set_tag(const StateHashSet_t *const set, const State s) {
+  PROFILE_START(start);
+  const long mask = set->capacity - 1;
+  long i = (long)(hash_state(s, set->key_len) & mask);
+  int tag = 0;
+
+  for (;;) {
+    State key = __atomic_load_n(&set->keys[i], __ATOMIC_ACQUIRE);
+    if (NULL == key) {
+      break;
+    }
+    if (0 == memcmp(key, s, set->key_len)) {
+      tag = __atomic_load_n(&set->tags[i], __ATOMIC_ACQUIRE);
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+
+  PROFILE_STOP(PROFILE_LOOKUP, start);
+  return tag;
+}
+
+/**
+ * Frees set along with the states it holds
+ * @param set a StateHashSet
+ */
+void free_hash_set(StateHashSet_t *set) {
+  for (long i = 0; i < set->capacity; ++i) {
+    free(set->keys[i]);
+  }
+  free(set->keys);
+  free(set->tags);
+  free(set);
+}
+
+/**
+ * FNV-1a hash of a state
+ * @param s a state
+ * @param key_len the number of chars in s
+ * @return the hash of s
+ */
+unsigned long hash_state(const State s, const int key_len) {
+  unsigned long h = 14695981039346656037UL;
+  for (int i = 0; i < key_len; ++i) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211UL;
+  }
+  return h;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASHSET_H
+#define HASHSET_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "states.h"
+
+struct StateHashSet {
+  State *keys;
+  int *tags;
+  long capacity;
+  int key_len;
+  int count;
+};
+
+typedef struct StateHashSet StateHashSet_t;
+
+StateHashSet_t *create_hash_set(const long, const int);
+int hash_set_insert(StateHashSet_t *, const State, int *);
+int hash_set_tag(const StateHashSet_t *const, const State);
+void free_hash_set(StateHashSet_t *);
+unsigned long hash_state(const State, const int);
+
+#endif
@@ -15,6 +15,8 @@
  */
 
 #include "TransverseHFK.h"
+#include "gridmoves.h"
+#include "resultcache.h"
 #include <argp.h>
 
 const char *argp_program_version = "transverseHFK revision 1.0.0";
@@ -38,12 +40,116 @@ static struct argp_option options[] = {
     {"Os", 'O', "[...]", 0, "List of Os", 0},
     {"sheets", 'n', "SHEETS", 0,
      "Number of sheets for cyclic branch cover. Default: 1", 0},
-    {"timeout", 't', "SECONDS", 0, "Maximum time to run in seconds", 0},
+    {"timeout", 't', "SECONDS", 0,
+     "Maximum time to calculate each invariant in seconds", 0},
+    {"threads", 'j', "THREADS", 0,
+     "Number of worker threads used to build each layer. Default: 1", 0},
+    {"pipeline", 'p', 0, 0,
+     "Contract the edges of each layer while the next layer is built", 0},
+    {"concurrent", 'c', 0, 0,
+     "Calculate the LL, UR, D1[LL] and D1[UR] invariants at the same time", 0},
+    {"first", 'f', 0, 0,
+     "Calculate the invariants at the same time and report each one as soon "
+     "as it is known",
+     0},
+    {"rectangle-cache", 'R', 0, 0,
+     "Share the rectangles found between the invariants of the grid", 0},
+    {"batch", 'b', "FILE", 0,
+     "Calculate every grid in FILE, one set of arguments per line. Reads "
+     "standard input if FILE is -",
+     0},
+    {"jobs", 'J', "JOBS", 0,
+     "Number of grids of a batch calculated at the same time. Default: 1", 0},
+    {"window", 'w', "LINES", 0,
+     "Most lines of a batch read ahead of the one being printed. Default: 4 "
+     "times JOBS",
+     0},
+    {"cache", 'C', "FILE", 0,
+     "Reuse the results kept in FILE and add the new ones to it", 0},
+    {"translate", 'T', 0, 0,
+     "Probe the translations of the grid and calculate each invariant on the "
+     "one estimated to be cheapest",
+     0},
+    {"estimate", 'E', "SAMPLES", 0,
+     "Estimate the size of each complex and the time and memory needed to "
+     "calculate it by sampling at most SAMPLES states of each layer",
+     0},
+    {"count-only", 'N', 0, 0,
+     "Print the number of states and edges of each layer of each complex "
+     "instead of calculating",
+     0},
+    {"depth", 'd', "LAYERS", 0,
+     "Stop each calculation, estimate or count after building A_i and B_i "
+     "for i up to LAYERS",
+     0},
+    {"checkpoint", 'k', "FILE", 0,
+     "Save each calculation to FILE.<invariant> between layers so that it "
+     "can be resumed",
+     0},
+    {"checkpoint-interval", 'I', "SECONDS", 0,
+     "Least time between two checkpoints of a calculation. Default: 300", 0},
+    {"resume", 'r', 0, 0,
+     "Carry on each calculation from its checkpoint when there is one", 0},
+    {"max-memory", 'M', "MB", 0,
+     "Most memory taken by the layers and edges of the calculations, which "
+     "are packed when it runs short and stopped if they still do not fit",
+     0},
+    {"telemetry", 'L', "FILE", 0,
+     "Write a JSON object describing each layer of each calculation to FILE, "
+     "one per line. Writes to standard output if FILE is -",
+     0},
+    {"no-simplify", 'S', 0, 0,
+     "Calculate on the grid as given instead of first removing the "
+     "destabilizations that keep its Legendrian type",
+     0},
     {0}};
 
+struct Invariant {
+  const char *header;
+  const char *name;
+  State state;
+  int d1;
+  int plus;
+  const Grid_t *G;
+  int result;
+  int done;
+  int reported;
+  char *output;
+  size_t output_size;
+  pthread_t thread;
+  ResultCache_t *results;
+  char *key;
+  int translate;
+  int max_time;
+  HFKEstimate_t estimate;
+  char *checkpoint;
+  HFKContext_t ctx;
+};
+
+#define PROBE_LAYERS 2
+
+static pthread_mutex_t invariants_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t invariant_done = PTHREAD_COND_INITIALIZER;
+
 static error_t parse_opt(int, char *, struct argp_state *);
-void timeout(const int);
 int build_permutation(State, char *, int);
+static int calculate_state(const struct Invariant *, const State,
+                           const Grid_t *const, HFKContext_t *);
+static int calculate_translated(struct Invariant *);
+static void calculate_invariant(struct Invariant *);
+static void *invariant_main(void *);
+static void print_result(const HFKContext_t *const, const char *,
+                         const int, const HFKContext_t *const);
+static void print_estimate(const HFKContext_t *const, const char *,
+                           const HFKEstimate_t *const);
+static void print_invariant(const HFKContext_t *const,
+                            const struct Invariant *);
+static void run_invariants(const HFKContext_t *const, struct Invariant *,
+                           const int, const int);
+static void simplify(const HFKContext_t *const, Grid_t *);
+static char *checkpoint_path(const char *, const char *);
+static void print_cache_stats(const HFKContext_t *const,
+                              const struct Invariant *, const int);
 
 static struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
 struct arguments {
@@ -52,41 +158,180 @@ struct arguments {
   char *Xs;
   char *Os;
   int max_time;
+  int concurrent;
+  int cache;
+  char *batch;
+  int jobs;
+  int window;
+  int translate;
+  int simplify;
+  int estimate;
+  char *cache_path;
+  char *telemetry_path;
+  ResultCache_t *results;
+  FILE *err;
+  HFKContext_t ctx;
 };
 
+struct Job {
+  struct arguments args;
+  char *line;
+  int parsed;
+  int status;
+  int done;
+  char *output;
+  size_t output_size;
+  char *errors;
+  size_t errors_size;
+};
+
+/**
+ * The lines of a batch between the one being printed (head) and the last
+ * one read (tail - 1). Lines from next on have not been started yet. Job i
+ * is kept in jobs[i % window].
+ */
+struct JobQueue {
+  struct Job *jobs;
+  int window;
+  long head;
+  long next;
+  long tail;
+  int eof;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t done;
+};
+
+static int run_grid(struct arguments *);
+static int split_line(char *, char *, char ***, int *);
+static void *batch_worker(void *);
+static int report_job(struct JobQueue *);
+static int run_parallel_batch(FILE *, char *, const struct arguments *);
+static int run_batch(const char *, char *, const struct arguments *);
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   struct arguments *args = state->input;
 
   switch (key) {
+  case ARGP_KEY_INIT:
+    state->err_stream = args->err;
+    break;
   case 'v':
-    set_verbosity(VERBOSE);
+    args->ctx.verbosity = VERBOSE;
     break;
   case 'q':
-    set_verbosity(QUIET);
+    args->ctx.verbosity = QUIET;
     break;
   case 's':
-    set_verbosity(SILENT);
+    args->ctx.verbosity = SILENT;
     break;
   case 't':
     args->max_time = atoi(arg);
     if (args->max_time <= 0) {
       argp_failure(state, 0, 0, "Invalid timeout");
-      exit(1);
+      return EINVAL;
+    }
+    break;
+  case 'p':
+    args->ctx.pipelined = 1;
+    break;
+  case 'c':
+    if (args->concurrent < 1) {
+      args->concurrent = 1;
+    }
+    break;
+  case 'f':
+    args->concurrent = 2;
+    break;
+  case 'R':
+    args->cache = 1;
+    break;
+  case 'b':
+    args->batch = arg;
+    break;
+  case 'J':
+    args->jobs = atoi(arg);
+    if (args->jobs < 1) {
+      argp_failure(state, 0, 0, "The number of jobs must be atleast 1.");
+      return EINVAL;
+    }
+    break;
+  case 'C':
+    args->cache_path = arg;
+    break;
+  case 'T':
+    args->translate = 1;
+    break;
+  case 'S':
+    args->simplify = 0;
+    break;
+  case 'k':
+    args->ctx.checkpoint = arg;
+    break;
+  case 'I':
+    args->ctx.checkpoint_interval = atof(arg);
+    if (args->ctx.checkpoint_interval < 0) {
+      argp_failure(state, 0, 0, "Invalid checkpoint interval");
+      return EINVAL;
+    }
+    break;
+  case 'r':
+    args->ctx.resume = 1;
+    break;
+  case 'L':
+    args->telemetry_path = arg;
+    break;
+  case 'M':
+    args->ctx.max_memory = (long)(atof(arg) * 1e6);
+    if (args->ctx.max_memory <= 0) {
+      argp_failure(state, 0, 0, "Invalid memory limit");
+      return EINVAL;
+    }
+    break;
+  case 'N':
+    args->ctx.count_only = 1;
+    break;
+  case 'd':
+    args->ctx.max_layers = atoi(arg);
+    if (args->ctx.max_layers < 1) {
+      argp_failure(state, 0, 0, "The depth must be atleast 1 layer.");
+      return EINVAL;
+    }
+    break;
+  case 'E':
+    args->estimate = atoi(arg);
+    if (args->estimate < 1) {
+      argp_failure(state, 0, 0, "The number of samples must be atleast 1.");
+      return EINVAL;
     }
     break;
+  case 'w':
+    args->window = atoi(arg);
+    if (args->window < 1) {
+      argp_failure(state, 0, 0, "The window must be atleast 1 line.");
+      return EINVAL;
+    }
+    break;
+  case 'j':
+    if (atoi(arg) < 1) {
+      argp_failure(state, 0, 0, "The number of threads must be atleast 1.");
+      return EINVAL;
+    }
+    args->ctx.threads = atoi(arg);
+    break;
   case 'i':
     args->arc_index = atoi(arg);
     if (args->arc_index < 2) {
       argp_failure(state, 0, 0,
                    "ArcIndex must be a non-negative integer greater than 1.");
-      exit(1);
+      return EINVAL;
     }
     break;
   case 'n':
     args->sheets = atoi(arg);
     if (args->sheets < 1) {
       argp_failure(state, 0, 0, "The number of sheets must be atleast 1.");
-      exit(1);
+      return EINVAL;
     }
     break;
   case 'X': {
@@ -101,17 +346,6 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
-/**
- * Signal handler for SIGALRM that exits when the signal is received.
- * @param sig
- */
-void timeout(const int sig) {
-  if (SIGALRM == sig) {
-    printf("Timeout reached. Terminating\n");
-    exit(0);
-  }
-}
-
 /**
  * Takes in a string and converts it into a permutation.
  * @param String of the form [_,_,...,_] where _ are integers
@@ -153,64 +387,431 @@ int build_permutation(char *perm, char *str, int len) {
   return 0;
 }
 
-int main(int argc, char **argv) {
-  struct arguments args;
-  args.arc_index = -1;
-  args.sheets = 1;
-  args.max_time = -1;
-  args.Xs = NULL;
-  args.Os = NULL;
-  argp_parse(&argp, argc, argv, 0, 0, &args);
+/**
+ * Calculates the invariant of the same kind as inv for state s of G
+ * @param inv an invariant
+ * @param s a state of G
+ * @param G a grid
+ * @param ctx the context of the calculation
+ * @return the result of the calculation
+ */
+static int calculate_state(const struct Invariant *inv, const State s,
+                           const Grid_t *const G, HFKContext_t *ctx) {
+  if (inv->d1) {
+    return null_homologous_D1Q(s, G, ctx);
+  }
+  return null_homologous_D0Q(s, G, ctx);
+}
 
-  if (args.arc_index == -1) {
-    fprintf(stderr, "transverseHFK: Missing arc_index\n");
-    exit(1);
+/**
+ * Calculates inv on a translation of its grid. The first PROBE_LAYERS
+ * layers are built for the translations of the grid by each number of
+ * columns, with the state of inv translated along. A probe that decides
+ * gives the result. Otherwise the calculation is finished on the translation
+ * whose probe explored the fewest states, the grid itself winning ties.
+ * Translations give isomorphic complexes, so the probes mostly differ in how
+ * soon the contraction decides. The rectangle cache of inv, filled for the
+ * grid itself, is only used on the grid itself. The probes and the choice
+ * are printed with QUIET or above.
+ * @param inv an invariant
+ * @return the result of the calculation
+ */
+static int calculate_translated(struct Invariant *inv) {
+  const int n = inv->G->arc_index;
+  Grid_t H = {malloc(sizeof(char) * n), malloc(sizeof(char) * n), n};
+  State s = malloc(sizeof(char) * n);
+  long best_states = -1;
+  int best = 0;
+  int result = HFK_UNKNOWN;
+
+  for (int c = 0; c < n && !is_context_cancelled(&inv->ctx); ++c) {
+    HFKContext_t probe = inv->ctx;
+    probe.verbosity = SILENT;
+    probe.max_layers = PROBE_LAYERS;
+    probe.checkpoint = NULL;
+    probe.telemetry = NULL;
+    memset(&probe.stats, 0, sizeof(HFKStats_t));
+    // The rectangle cache holds the rectangles of the untranslated grid
+    if (0 != c) {
+      probe.rectangles = NULL;
+    }
+
+    translate_state(H.Xs, inv->G->Xs, c, 0, n);
+    translate_state(H.Os, inv->G->Os, c, 0, n);
+    translate_state(s, inv->state, c, 0, n);
+    result = calculate_state(inv, s, &H, &probe);
+    if (QUIET <= inv->ctx.verbosity) {
+      hfk_printf(&inv->ctx, "Probe of %s shifted by %d columns: %ld states%s\n",
+                 inv->name, c, probe.stats.states,
+                 (HFK_UNKNOWN == result) ? "" : ", decided");
+    }
+    if (HFK_UNKNOWN != result) {
+      break;
+    }
+    if (best_states < 0 || probe.stats.states < best_states) {
+      best_states = probe.stats.states;
+      best = c;
+    }
   }
 
-  if (args.Xs == NULL) {
-    fprintf(stderr, "transverseHFK: Missing Xs\n");
-    exit(1);
+  if (HFK_UNKNOWN == result && !is_context_cancelled(&inv->ctx)) {
+    if (QUIET <= inv->ctx.verbosity) {
+      hfk_printf(&inv->ctx, "Calculating %s shifted by %d columns\n",
+                 inv->name, best);
+    }
+    translate_state(H.Xs, inv->G->Xs, best, 0, n);
+    translate_state(H.Os, inv->G->Os, best, 0, n);
+    translate_state(s, inv->state, best, 0, n);
+    RectangleCache_t *cache = inv->ctx.rectangles;
+    if (0 != best) {
+      inv->ctx.rectangles = NULL;
+    }
+    result = calculate_state(inv, s, &H, &inv->ctx);
+    inv->ctx.rectangles = cache;
   }
 
-  if (args.Os == NULL) {
-    fprintf(stderr, "transverseHFK: Missing Os\n");
-    exit(1);
+  free(H.Xs);
+  free(H.Os);
+  free(s);
+
+  return result;
+}
+
+/**
+ * Calculates inv, or looks it up if it is in the result cache. Results that
+ * are calculated are added to the cache. The timeout of inv runs from the
+ * start of its own calculation.
+ * @param inv an invariant
+ */
+static void calculate_invariant(struct Invariant *inv) {
+  if (NULL != inv->results) {
+    inv->result = result_cache_get(inv->results, inv->key);
+    if (inv->result >= 0) {
+      return;
+    }
+  }
+
+  if (inv->max_time > 0) {
+    set_context_deadline(&inv->ctx, inv->max_time);
+  }
+  if (inv->translate) {
+    inv->result = calculate_translated(inv);
+  } else {
+    inv->result = calculate_state(inv, inv->state, inv->G, &inv->ctx);
+  }
+
+  if (NULL != inv->results && HFK_UNKNOWN != inv->result) {
+    result_cache_put(inv->results, inv->key, inv->result);
+  }
+}
+
+/**
+ * Thread body calculating a single invariant. Everything the calculation
+ * prints is kept in inv->output until the invariant is reported.
+ * @param arg a struct Invariant
+ */
+static void *invariant_main(void *arg) {
+  struct Invariant *inv = arg;
+  FILE *stream = open_memstream(&inv->output, &inv->output_size);
+
+  inv->ctx.print = print_to_stream;
+  inv->ctx.print_data = stream;
+  calculate_invariant(inv);
+  fclose(stream);
+
+  pthread_mutex_lock(&invariants_lock);
+  inv->done = 1;
+  // Grids of a batch may be waiting on their own invariants at the same time
+  pthread_cond_broadcast(&invariant_done);
+  pthread_mutex_unlock(&invariants_lock);
+
+  return NULL;
+}
+
+/**
+ * Prints whether the invariant called name is null-homologous. When it is
+ * unknown the estimate or the counts made instead are printed, or why the
+ * calculation stopped. With QUIET or above a calculation that timed out also
+ * prints the layer it reached and the states and edges it found.
+ * @param ctx the context of the program
+ * @param name the name of the invariant
+ * @param result what the calculation of the invariant returned
+ * @param calc the context the invariant was calculated with
+ */
+static void print_result(const HFKContext_t *const ctx, const char *name,
+                         const int result, const HFKContext_t *const calc) {
+  if (HFK_UNKNOWN != result) {
+    hfk_printf(ctx, result ? "%s is null-homologous\n"
+                           : "%s is NOT null-homologous\n",
+               name);
+  } else if (NULL != calc->estimate && calc->estimate->layers > 0) {
+    print_estimate(ctx, name, calc->estimate);
+  } else if (calc->out_of_memory) {
+    hfk_printf(ctx,
+               "%s is unknown (memory) after %ld layers, %ld states and %ld "
+               "edges\n",
+               name, calc->stats.layers, calc->stats.states,
+               calc->stats.edges);
+  } else if (calc->count_only) {
+    hfk_printf(ctx, "%s has %ld states and %ld edges\n", name,
+               calc->stats.states, calc->stats.edges);
+  } else if (calc->max_layers > 0 && !is_context_cancelled(calc)) {
+    hfk_printf(ctx, "%s is unknown (depth limit)\n", name);
+  } else {
+    const long layers = calc->stats.layers;
+    hfk_printf(ctx, "%s is unknown (timeout)", name);
+    if (QUIET <= ctx->verbosity && layers > 0) {
+      hfk_printf(ctx, " at %c_%ld after %ld states and %ld edges",
+                 (layers % 2) ? 'A' : 'B', (layers + 1) / 2,
+                 calc->stats.states, calc->stats.edges);
+    }
+    hfk_printf(ctx, "\n");
+  }
+}
+
+/**
+ * Prints the predicted size of each layer of the complex of the invariant
+ * called name, followed by the totals and the time and memory its
+ * calculation would take if it went through every layer estimated
+ * @param ctx the context of the program
+ * @param name the name of the invariant
+ * @param estimate a filled in estimate
+ */
+static void print_estimate(const HFKContext_t *const ctx, const char *name,
+                           const HFKEstimate_t *const estimate) {
+  double states = 0, edges = 0;
+  int i;
+
+  for (i = 0; i < estimate->layers; ++i) {
+    hfk_printf(ctx, "%s %c_%d: %.0f states, %.0f edges%s\n", name,
+               (i % 2) ? 'A' : 'B', (i + 1) / 2, estimate->states[i],
+               estimate->edges[i], (i < estimate->exact) ? "" : " (estimated)");
+    states += estimate->states[i];
+    edges += estimate->edges[i];
+  }
+  --i;
+  hfk_printf(ctx,
+             "%s is estimated at %.0f states and %.0f edges up to %c_%d, "
+             "%.2f seconds and %.1f MB\n",
+             name, states, edges, (i % 2) ? 'A' : 'B', (i + 1) / 2,
+             states * estimate->seconds_per_state,
+             estimate->peak_bytes / 1e6);
+}
+
+/**
+ * Prints the header of inv, the output of its calculation if it ran on its
+ * own thread, and the result.
+ * @param ctx the context of the program
+ * @param inv a calculated invariant
+ */
+static void print_invariant(const HFKContext_t *const ctx,
+                            const struct Invariant *inv) {
+  if (QUIET <= ctx->verbosity) {
+    hfk_printf(ctx, "%s", inv->header);
+    print_state(ctx, inv->state, inv->G);
+    print_2AM(ctx, inv->G, inv->plus);
+  }
+  if (NULL != inv->output) {
+    hfk_printf(ctx, "%s", inv->output);
+  }
+  print_result(ctx, inv->name, inv->result, &inv->ctx);
+}
+
+/**
+ * Calculates and reports the invariants. With concurrent equal to 0 they are
+ * calculated one after another. Otherwise each one is calculated on its own
+ * thread and they are reported in order when concurrent is 1, or in the
+ * order they finish when concurrent is 2. Each invariant is calculated with
+ * its own copy of ctx, which is pointed at the estimate of the invariant
+ * when it asks for samples and at the checkpoint file of the invariant.
+ * Invariants calculated at the same time share the memory budget equally.
+ * @param ctx the context of the program
+ * @param invs the invariants
+ * @param n the number of invariants
+ * @param concurrent 0, 1 or 2
+ */
+static void run_invariants(const HFKContext_t *const ctx,
+                           struct Invariant *invs, const int n,
+                           const int concurrent) {
+  for (int i = 0; i < n; ++i) {
+    invs[i].ctx = *ctx;
+    if (invs[i].estimate.samples > 0) {
+      invs[i].ctx.estimate = &invs[i].estimate;
+    }
+    invs[i].ctx.checkpoint = invs[i].checkpoint;
+    invs[i].ctx.label = invs[i].name;
+    if (concurrent) {
+      invs[i].ctx.max_memory = ctx->max_memory / n;
+    }
+  }
+
+  if (!concurrent) {
+    for (int i = 0; i < n; ++i) {
+      if (QUIET <= ctx->verbosity) {
+        hfk_printf(ctx, "%s", invs[i].header);
+        print_state(ctx, invs[i].state, invs[i].G);
+        print_2AM(ctx, invs[i].G, invs[i].plus);
+      }
+      calculate_invariant(&invs[i]);
+      print_result(ctx, invs[i].name, invs[i].result, &invs[i].ctx);
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    pthread_create(&invs[i].thread, NULL, invariant_main, &invs[i]);
+  }
+
+  for (int k = 0; k < n; ++k) {
+    int next = k;
+    if (2 == concurrent) {
+      // Report whichever unreported invariant finished first
+      pthread_mutex_lock(&invariants_lock);
+      for (;;) {
+        for (next = 0; next < n; ++next) {
+          if (invs[next].done && !invs[next].reported) {
+            break;
+          }
+        }
+        if (next < n) {
+          break;
+        }
+        pthread_cond_wait(&invariant_done, &invariants_lock);
+      }
+      pthread_mutex_unlock(&invariants_lock);
+    }
+    pthread_join(invs[next].thread, NULL);
+    invs[next].reported = 1;
+    print_invariant(ctx, &invs[next]);
+    fflush(stdout);
+    free(invs[next].output);
+    invs[next].output = NULL;
+  }
+}
+
+/**
+ * Prints how often the rectangle cache was hit by the calculations
+ * @param ctx the context of the program
+ * @param invs the calculated invariants
+ * @param n the number of invariants
+ */
+static void print_cache_stats(const HFKContext_t *const ctx,
+                              const struct Invariant *invs, const int n) {
+  long hits = 0, misses = 0;
+  for (int i = 0; i < n; ++i) {
+    hits += invs[i].ctx.stats.cache_hits;
+    misses += invs[i].ctx.stats.cache_misses;
+  }
+  hfk_printf(ctx, "\nRectangle cache: %ld hits, %ld misses (%.1f%% hit rate)\n",
+             hits, misses,
+             (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0);
+}
+
+/**
+ * Simplifies G by Legendrian destabilizations before its invariants are
+ * calculated, and reports the moves made when there were any
+ * @param ctx the context of the program
+ * @param G a grid, simplified in place
+ */
+static void simplify(const HFKContext_t *const ctx, Grid_t *G) {
+  Simplification_t moves;
+  simplify_grid(G, &moves);
+  if (QUIET <= ctx->verbosity && 0 < moves.destabilizations) {
+    hfk_printf(ctx,
+               "Simplified to arc index %d by %d commutations and %d "
+               "destabilizations\n",
+               G->arc_index, moves.commutations, moves.destabilizations);
+  }
+}
+
+/**
+ * @param path the checkpoint file given on the command line, or NULL
+ * @param name the name of an invariant
+ * @return the checkpoint file of the invariant, path.name, to be freed by the
+ * caller, or NULL if path is NULL
+ */
+static char *checkpoint_path(const char *path, const char *name) {
+  if (NULL == path) {
+    return NULL;
+  }
+  char *file = malloc(sizeof(char) * (strlen(path) + strlen(name) + 2));
+  sprintf(file, "%s.%s", path, name);
+  return file;
+}
+
+/**
+ * Calculates the invariants of the grid described by args. Results are
+ * printed through args->ctx and errors to args->err. Each invariant has
+ * args->max_time seconds, after which it is reported as unknown and the next
+ * one is calculated.
+ * @param args the parsed arguments of a single grid
+ * @return 0 on success and 1 if the arguments do not describe a valid grid
+ */
+static int run_grid(struct arguments *args) {
+  // A verbose run is meant to print the calculation, so it does not reuse
+  // results that are only kept in memory
+  if (VERBOSE <= args->ctx.verbosity && NULL != args->results &&
+      NULL == args->results->file) {
+    args->results = NULL;
+  }
+  // Nor does an estimate or a count, which would find a result and print
+  // nothing else
+  if (args->estimate > 0 || args->ctx.count_only) {
+    args->results = NULL;
+    args->translate = 0;
+  }
+
+  if (args->arc_index == -1) {
+    fprintf(args->err, "transverseHFK: Missing arc_index\n");
+    return 1;
+  }
+
+  if (args->Xs == NULL) {
+    fprintf(args->err, "transverseHFK: Missing Xs\n");
+    return 1;
+  }
+
+  if (args->Os == NULL) {
+    fprintf(args->err, "transverseHFK: Missing Os\n");
+    return 1;
   }
 
-  if (args.sheets > 1) {
+  if (args->sheets > 1) {
     LiftGrid_t G;
-    G.arc_index = args.arc_index;
-    G.sheets = args.sheets;
+    G.arc_index = args->arc_index;
+    G.sheets = args->sheets;
     G.Xs = malloc(sizeof(char) * G.arc_index);
     G.Os = malloc(sizeof(char) * G.arc_index);
 
-    if (-1 == build_permutation(G.Xs, args.Xs, args.arc_index)) {
-      fprintf(stderr, "transverseHFK: Malformatted Xs\n");
+    if (-1 == build_permutation(G.Xs, args->Xs, args->arc_index)) {
+      fprintf(args->err, "transverseHFK: Malformatted Xs\n");
       free(G.Xs);
       free(G.Os);
-      exit(1);
+      return 1;
     }
 
-    if (-1 == build_permutation(G.Os, args.Os, args.arc_index)) {
-      fprintf(stderr, "transverseHFK: Malformatted Os\n");
+    if (-1 == build_permutation(G.Os, args->Os, args->arc_index)) {
+      fprintf(args->err, "transverseHFK: Malformatted Os\n");
       free(G.Xs);
       free(G.Os);
-      exit(1);
+      return 1;
     }
 
     if (!is_lift_grid(&G)) {
-      printf("Invalid grid\n");
-      exit(1);
+      hfk_printf(&args->ctx, "Invalid grid\n");
+      free(G.Xs);
+      free(G.Os);
+      return 1;
     }
 
-    if (args.max_time > 0) {
-      if (signal(SIGALRM, timeout) == SIG_ERR) {
-        perror("An error occured while setting the timer");
-        free(G.Xs);
-        free(G.Os);
-        exit(1);
-      }
-      alarm(args.max_time);
+    if (args->simplify) {
+      Grid_t H;
+      H.arc_index = G.arc_index;
+      H.Xs = G.Xs;
+      H.Os = G.Os;
+
+      simplify(&args->ctx, &H);
+      G.arc_index = H.arc_index;
     }
 
     LiftState UR_lift;
@@ -231,96 +832,101 @@ int main(int argc, char **argv) {
       }
     }
 
-    if (QUIET <= get_verbosity()) {
+    if (QUIET <= args->ctx.verbosity) {
       Grid_t H;
       H.arc_index = G.arc_index;
       H.Xs = G.Xs;
       H.Os = G.Os;
 
-      print_grid(&H);
-      print_tb_r(&H);
-      printf("\n");
+      print_grid(&args->ctx, &H);
+      print_tb_r(&args->ctx, &H);
+      hfk_printf(&args->ctx, "\n");
     }
 
-    if (QUIET <= get_verbosity()) {
-      printf("Calculating graph for lifted invariant.\n");
-      print_lift_state(UR_lift, &G);
-      printf("\n");
+    if (QUIET <= args->ctx.verbosity) {
+      hfk_printf(&args->ctx, "Calculating graph for lifted invariant.\n");
+      print_lift_state(&args->ctx, UR_lift, &G);
+      hfk_printf(&args->ctx, "\n");
     }
 
-    if (null_homologous_lift(UR_lift, &G)) {
-      printf("theta_%d is null-homologous\n", G.sheets);
-    } else {
-      printf("theta_%d is NOT null-homologous\n", G.sheets);
+    char name[32];
+    char *key = NULL;
+    int result = -1;
+    snprintf(name, sizeof(name), "theta_%d", G.sheets);
+    if (NULL != args->results) {
+      key = result_key(G.Xs, G.Os, G.arc_index, G.sheets, "theta");
+      result = result_cache_get(args->results, key);
+    }
+    HFKEstimate_t estimate = {.samples = args->estimate, .seed = 1};
+    const char *checkpoint = args->ctx.checkpoint;
+    char *lift_checkpoint = checkpoint_path(checkpoint, name);
+    if (args->estimate > 0) {
+      args->ctx.estimate = &estimate;
+    }
+    args->ctx.checkpoint = lift_checkpoint;
+    args->ctx.label = name;
+    if (result < 0) {
+      if (args->max_time > 0) {
+        set_context_deadline(&args->ctx, args->max_time);
+      }
+      result = null_homologous_lift(UR_lift, &G, &args->ctx);
+      if (NULL != key && HFK_UNKNOWN != result) {
+        result_cache_put(args->results, key, result);
+      }
     }
+    print_result(&args->ctx, name, result, &args->ctx);
+    args->ctx.estimate = NULL;
+    args->ctx.checkpoint = checkpoint;
+    args->ctx.label = "";
+    free(lift_checkpoint);
+    free(key);
 
     free(G.Xs);
     free(G.Os);
     free_lift_state(&UR_lift, &G);
 
-    exit(0);
+    return 0;
   }
 
   Grid_t G;
-  G.arc_index = args.arc_index;
+  G.arc_index = args->arc_index;
   G.Xs = malloc(sizeof(char) * G.arc_index);
   G.Os = malloc(sizeof(char) * G.arc_index);
 
-  if (-1 == build_permutation(G.Xs, args.Xs, args.arc_index)) {
-    fprintf(stderr, "transverseHFK: Malformatted Xs\n");
+  if (-1 == build_permutation(G.Xs, args->Xs, args->arc_index)) {
+    fprintf(args->err, "transverseHFK: Malformatted Xs\n");
     free(G.Xs);
     free(G.Os);
-    exit(1);
+    return 1;
   }
 
-  if (-1 == build_permutation(G.Os, args.Os, args.arc_index)) {
-    fprintf(stderr, "transverseHFK: Malformatted Os\n");
+  if (-1 == build_permutation(G.Os, args->Os, args->arc_index)) {
+    fprintf(args->err, "transverseHFK: Malformatted Os\n");
     free(G.Xs);
     free(G.Os);
-    exit(1);
+    return 1;
   }
 
   State UR = malloc(sizeof(char) * G.arc_index);
   int i;
 
   if (!is_grid(&G)) {
-    printf("Invalid grid\n");
+    hfk_printf(&args->ctx, "Invalid grid\n");
     free(G.Xs);
     free(G.Os);
     free(UR);
-    exit(1);
+    return 1;
   }
 
-  if (args.max_time > 0) {
-    if (signal(SIGALRM, timeout) == SIG_ERR) {
-      perror("An error occured while setting the timer");
-      free(G.Xs);
-      free(G.Os);
-      free(UR);
-      exit(1);
-    }
-    alarm(args.max_time);
+  if (args->simplify) {
+    simplify(&args->ctx, &G);
   }
 
-  if (QUIET <= get_verbosity()) {
-    print_grid(&G);
-    print_tb_r(&G);
+  if (QUIET <= args->ctx.verbosity) {
+    print_grid(&args->ctx, &G);
+    print_tb_r(&args->ctx, &G);
   }
 
-  if (QUIET <= get_verbosity()) {
-    printf("\n \nCalculating graph for LL invariant\n");
-    print_state(G.Xs, &G);
-    print_2AM(&G, 0);
-  }
-  if (null_homologous_D0Q(G.Xs, &G)) {
-    printf("LL is null-homologous\n");
-  } else {
-    printf("LL is NOT null-homologous\n");
-  }
-
-  if (QUIET <= get_verbosity()) {
-    printf("\nCalculating graph for UR invariant\n");
-  }
   if (G.Xs[G.arc_index - 1] == G.arc_index) {
     UR[0] = 1;
   } else {
@@ -335,62 +941,396 @@ int main(int argc, char **argv) {
     }
     ++i;
   }
-  if (QUIET <= get_verbosity()) {
-    print_state(UR, &G);
-    print_2AM(&G, 1);
+
+  struct Invariant invs[4] = {
+      {.header = "\n \nCalculating graph for LL invariant\n",
+       .name = "LL",
+       .state = G.Xs,
+       .d1 = 0,
+       .plus = 0,
+       .G = &G},
+      {.header = "\nCalculating graph for UR invariant\n",
+       .name = "UR",
+       .state = UR,
+       .d1 = 0,
+       .plus = 1,
+       .G = &G},
+      {.header = "\nCalculating graph for D1[LL] invariant\n",
+       .name = "D1[LL]",
+       .state = G.Xs,
+       .d1 = 1,
+       .plus = 0,
+       .G = &G},
+      {.header = "\nCalculating graph for D1[UR] invariant\n",
+       .name = "D1[UR]",
+       .state = UR,
+       .d1 = 1,
+       .plus = 1,
+       .G = &G}};
+  if (args->cache) {
+    args->ctx.rectangles = create_rectangle_cache(&G);
+  }
+  for (i = 0; i < 4; ++i) {
+    invs[i].translate = args->translate;
+    invs[i].max_time = args->max_time;
+    invs[i].estimate.samples = args->estimate;
+    invs[i].estimate.seed = 1;
+    invs[i].results = args->results;
+    invs[i].checkpoint = checkpoint_path(args->ctx.checkpoint, invs[i].name);
+    invs[i].key = (NULL == args->results)
+                      ? NULL
+                      : result_key(G.Xs, G.Os, G.arc_index, 1, invs[i].name);
   }
 
-  if (null_homologous_D0Q(UR, &G)) {
-    printf("UR is null-homologous\n");
-  } else {
-    printf("UR is NOT null-homologous\n");
-  };
+  run_invariants(&args->ctx, invs, 4, args->concurrent);
 
-  if (QUIET <= get_verbosity()) {
-    printf("\nCalculating graph for D1[LL] invariant\n");
-    print_state(G.Xs, &G);
-    print_2AM(&G, 0);
+  for (i = 0; i < 4; ++i) {
+    free(invs[i].key);
+    free(invs[i].checkpoint);
   }
 
-  if (null_homologous_D1Q(G.Xs, &G)) {
-    printf("D1[LL] is null-homologous\n");
-  } else {
-    printf("D1[LL] is NOT null-homologous\n");
+  if (NULL != args->ctx.rectangles) {
+    if (QUIET <= args->ctx.verbosity) {
+      print_cache_stats(&args->ctx, invs, 4);
+    }
+    free_rectangle_cache(args->ctx.rectangles);
   }
 
-  if (QUIET <= get_verbosity()) {
-    printf("\nCalculating graph for D1[UR] invariant\n");
+  free(G.Xs);
+  free(G.Os);
+  free(UR);
+
+  return 0;
+}
+
+/**
+ * Splits a line of a batch file into the argument vector of a single grid.
+ * The arguments point into line.
+ * @param line a line of a batch file, modified in place
+ * @param program the name the program was run with, used as argv[0]
+ * @param argv the argument vector, grown as needed
+ * @param argv_size the number of entries allocated for argv
+ * @return the number of arguments including argv[0]
+ */
+static int split_line(char *line, char *program, char ***argv,
+                      int *argv_size) {
+  int argc = 1;
+  char *save = NULL;
+
+  for (char *tok = strtok_r(line, " \t\r\n", &save); NULL != tok;
+       tok = strtok_r(NULL, " \t\r\n", &save)) {
+    if (argc + 1 >= *argv_size) {
+      *argv_size = (0 == *argv_size) ? 16 : 2 * *argv_size;
+      *argv = realloc(*argv, sizeof(char *) * *argv_size);
+    }
+    (*argv)[argc++] = tok;
+  }
+  if (argc > 1) {
+    (*argv)[0] = program;
+    (*argv)[argc] = NULL;
   }
 
-  if (G.Xs[G.arc_index - 1] == G.arc_index) {
-    UR[0] = 1;
-  } else {
-    UR[0] = (char)G.Xs[G.arc_index - 1] + 1;
-  };
-  i = 1;
-  while (i <= G.arc_index - 1) {
-    if (G.Xs[i - 1] == G.arc_index) {
-      UR[i] = 1;
-    } else {
-      UR[i] = G.Xs[i - 1] + 1;
+  return argc;
+}
+
+/**
+ * Thread body of the workers of a parallel batch. Takes the oldest line that
+ * has not been started until the input ends.
+ * @param arg a struct JobQueue
+ */
+static void *batch_worker(void *arg) {
+  struct JobQueue *q = arg;
+
+  pthread_mutex_lock(&q->lock);
+  for (;;) {
+    while (q->next == q->tail && !q->eof) {
+      pthread_cond_wait(&q->ready, &q->lock);
     }
-    i++;
+    if (q->next == q->tail) {
+      break;
+    }
+    struct Job *job = &q->jobs[q->next++ % q->window];
+    pthread_mutex_unlock(&q->lock);
+
+    job->status = job->parsed ? run_grid(&job->args) : 1;
+    fclose(job->args.ctx.print_data);
+    fclose(job->args.err);
+
+    pthread_mutex_lock(&q->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&q->done);
   }
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+}
 
-  if (QUIET <= get_verbosity()) {
-    print_state(UR, &G);
-    print_2AM(&G, 1);
+/**
+ * Waits for the line at the head of q to finish, prints what it printed and
+ * frees it. Must be called with q->lock held.
+ * @param q the lines of a batch
+ * @return the status of the line
+ */
+static int report_job(struct JobQueue *q) {
+  struct Job *job = &q->jobs[q->head % q->window];
+
+  while (!job->done) {
+    pthread_cond_wait(&q->done, &q->lock);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  fwrite(job->errors, sizeof(char), job->errors_size, stderr);
+  fwrite(job->output, sizeof(char), job->output_size, stdout);
+  fflush(stderr);
+  fflush(stdout);
+  free(job->errors);
+  free(job->output);
+  free(job->line);
+
+  pthread_mutex_lock(&q->lock);
+  q->head++;
+
+  return job->status;
+}
+
+/**
+ * Calculates the grids of a batch base->jobs at a time. Everything a line
+ * prints is kept until the lines before it have been printed, so the output
+ * is the same as calculating them in order. At most base->window lines are
+ * held at once, which bounds the memory used when the lines are cheap to
+ * read but expensive to calculate.
+ * @param in the batch file
+ * @param program the name the program was run with
+ * @param base the arguments given on the command line
+ * @return 0 if every line described a valid grid and 1 otherwise
+ */
+static int run_parallel_batch(FILE *in, char *program,
+                              const struct arguments *base) {
+  struct JobQueue q;
+  pthread_t *workers = malloc(sizeof(pthread_t) * base->jobs);
+  char *line = NULL;
+  size_t line_size = 0;
+  char **line_argv = NULL;
+  int argv_size = 0;
+  int status = 0;
+
+  q.window = (base->window > 0) ? base->window : 4 * base->jobs;
+  q.jobs = malloc(sizeof(struct Job) * q.window);
+  q.head = 0;
+  q.next = 0;
+  q.tail = 0;
+  q.eof = 0;
+  pthread_mutex_init(&q.lock, NULL);
+  pthread_cond_init(&q.ready, NULL);
+  pthread_cond_init(&q.done, NULL);
+
+  for (int i = 0; i < base->jobs; ++i) {
+    pthread_create(&workers[i], NULL, batch_worker, &q);
+  }
+
+  while (-1 != getline(&line, &line_size, in)) {
+    char *copy = strdup(line);
+    const int line_argc = split_line(copy, program, &line_argv, &argv_size);
+    if (1 == line_argc) {
+      free(copy);
+      continue;
+    }
+
+    // Print the lines that are done and wait for a free slot
+    pthread_mutex_lock(&q.lock);
+    while (q.head < q.tail &&
+           (q.tail - q.head == q.window || q.jobs[q.head % q.window].done)) {
+      status |= report_job(&q);
+    }
+    pthread_mutex_unlock(&q.lock);
+
+    // Only this thread touches the slot at tail until tail is advanced
+    struct Job *job = &q.jobs[q.tail % q.window];
+    FILE *out;
+    job->line = copy;
+    job->args = *base;
+    job->args.batch = NULL;
+    job->args.ctx.max_memory = base->ctx.max_memory / base->jobs;
+    job->status = 0;
+    job->done = 0;
+    job->output = NULL;
+    job->errors = NULL;
+    out = open_memstream(&job->output, &job->output_size);
+    job->args.err = open_memstream(&job->errors, &job->errors_size);
+    job->args.ctx.print_data = out;
+    job->parsed = (0 == argp_parse(&argp, line_argc, line_argv, ARGP_NO_EXIT,
+                                   0, &job->args));
+
+    pthread_mutex_lock(&q.lock);
+    q.tail++;
+    pthread_cond_signal(&q.ready);
+    pthread_mutex_unlock(&q.lock);
+  }
+
+  pthread_mutex_lock(&q.lock);
+  q.eof = 1;
+  pthread_cond_broadcast(&q.ready);
+  while (q.head < q.tail) {
+    status |= report_job(&q);
+  }
+  pthread_mutex_unlock(&q.lock);
+
+  for (int i = 0; i < base->jobs; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+  pthread_mutex_destroy(&q.lock);
+  pthread_cond_destroy(&q.ready);
+  pthread_cond_destroy(&q.done);
+  free(q.jobs);
+  free(workers);
+  free(line_argv);
+  free(line);
+
+  return status;
+}
+
+/**
+ * Calculates the grids of a batch file in order. Each line holds the
+ * arguments of one grid as they would be passed on the command line, and
+ * the options given on the command line apply to every line. An invariant
+ * that reaches its timeout is reported as unknown. Without a result cache
+ * the results are kept in memory, so a grid that is a translation of an
+ * earlier one is not calculated again.
+ * @param path the batch file, or - for standard input
+ * @param program the name the program was run with
+ * @param base the arguments given on the command line
+ * @return 0 if every line described a valid grid and 1 otherwise
+ */
+static int run_batch(const char *path, char *program,
+                     const struct arguments *base) {
+  FILE *in = (0 == strcmp(path, "-")) ? stdin : fopen(path, "r");
+  struct arguments shared = *base;
+  Scheduler_t *scheduler = NULL;
+  char *line = NULL;
+  size_t line_size = 0;
+  char **line_argv = NULL;
+  int argv_size = 0;
+  int status = 0;
+
+  if (NULL == in) {
+    fprintf(stderr, "transverseHFK: Could not open %s\n", path);
+    return 1;
+  }
+
+  if (NULL == shared.results) {
+    shared.results = create_result_cache();
+  }
+
+  if (shared.jobs > 1) {
+    status = run_parallel_batch(in, program, &shared);
+    if (shared.results != base->results) {
+      close_result_cache(shared.results);
+    }
+    if (stdin != in) {
+      fclose(in);
+    }
+    return status;
+  }
+
+  // The threads of a single scheduler are shared by every grid. Concurrent
+  // invariants need one each so they create their own.
+  if (shared.ctx.threads > 1 && !shared.concurrent) {
+    scheduler = create_scheduler(shared.ctx.threads);
   }
 
-  if (null_homologous_D1Q(UR, &G)) {
-    printf("D1[UR] is null-homologous\n");
+  while (-1 != getline(&line, &line_size, in)) {
+    struct arguments args = shared;
+    const int line_argc = split_line(line, program, &line_argv, &argv_size);
+    if (1 == line_argc) {
+      continue;
+    }
+
+    args.batch = NULL;
+    args.ctx.scheduler = scheduler;
+    if (0 != argp_parse(&argp, line_argc, line_argv, ARGP_NO_EXIT, 0, &args) ||
+        0 != run_grid(&args)) {
+      status = 1;
+    }
+    fflush(stdout);
+  }
+
+  if (NULL != scheduler) {
+    free_scheduler(scheduler);
+  }
+  if (shared.results != base->results) {
+    close_result_cache(shared.results);
+  }
+  free(line_argv);
+  free(line);
+  if (stdin != in) {
+    fclose(in);
+  }
+
+  return status;
+}
+
+int main(int argc, char **argv) {
+  struct arguments args;
+  int status;
+  args.arc_index = -1;
+  args.sheets = 1;
+  args.max_time = -1;
+  args.Xs = NULL;
+  args.Os = NULL;
+  args.concurrent = 0;
+  args.cache = 0;
+  args.batch = NULL;
+  args.jobs = 1;
+  args.window = 0;
+  args.translate = 0;
+  args.simplify = 1;
+  args.estimate = 0;
+  args.cache_path = NULL;
+  args.telemetry_path = NULL;
+  args.results = NULL;
+  args.err = stderr;
+  init_context(&args.ctx);
+  args.ctx.checkpoint_interval = 300;
+  if (0 != argp_parse(&argp, argc, argv, 0, 0, &args)) {
+    exit(1);
+  }
+
+  // A single cache is shared by every line of a batch
+  if (NULL != args.cache_path) {
+    args.results = open_result_cache(args.cache_path);
+    if (NULL == args.results) {
+      fprintf(stderr, "transverseHFK: Could not open %s\n", args.cache_path);
+      exit(1);
+    }
+  }
+
+  // As is the telemetry, whose lines name the invariant they describe
+  if (NULL != args.telemetry_path) {
+    args.ctx.telemetry = (0 == strcmp(args.telemetry_path, "-"))
+                             ? stdout
+                             : fopen(args.telemetry_path, "w");
+    if (NULL == args.ctx.telemetry) {
+      fprintf(stderr, "transverseHFK: Could not open %s\n",
+              args.telemetry_path);
+      exit(1);
+    }
+  }
+
+  if (NULL != args.batch) {
+    status = run_batch(args.batch, argv[0], &args);
   } else {
-    printf("D1[UR] is NOT null-homologous\n");
-  };
+    status = run_grid(&args);
+  }
 
-  free(G.Xs);
-  free(G.Os);
-  free(UR);
+  if (NULL != args.ctx.telemetry && stdout != args.ctx.telemetry) {
+    fclose(args.ctx.telemetry);
+  }
 
-  return 0;
+  if (NULL != args.results) {
+    close_result_cache(args.results);
+  }
+  // Only builds with HFK_PROFILE or HFK_TRACK_ALLOC have anything to print
+  print_profile(stderr);
+  print_allocations(stderr);
+  exit(status);
 }
@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "profile.h"
+#include <string.h>
+
+#ifdef HFK_PROFILE
+ProfileCounter_t profile_phases[PROFILE_PHASES];
+unsigned long long profile_events[PROFILE_EVENTS];
+#endif
+
+static const char *phase_names[PROFILE_PHASES] = {"enumerate", "lookup",
+                                                  "sort_edges", "contract"};
+static const char *event_names[PROFILE_EVENTS] = {"rectangles", "cancelled",
+                                                  "contractions"};
+
+/**
+ * Copies the counters gathered so far
+ * @param phases destination for PROFILE_PHASES counters
+ * @param events destination for PROFILE_EVENTS counts
+ * @return 1 if built with HFK_PROFILE, 0 otherwise in which case nothing is
+ * copied
+ */
+int get_profile(ProfileCounter_t *phases, unsigned long long *events) {
+#ifdef HFK_PROFILE
+  for (int i = 0; i < PROFILE_PHASES; ++i) {
+    phases[i].calls =
+        __atomic_load_n(&profile_phases[i].calls, __ATOMIC_RELAXED);
+    phases[i].ticks =
+        __atomic_load_n(&profile_phases[i].ticks, __ATOMIC_RELAXED);
+  }
+  for (int i = 0; i < PROFILE_EVENTS; ++i) {
+    events[i] = __atomic_load_n(&profile_events[i], __ATOMIC_RELAXED);
+  }
+  return 1;
+#else
+  (void)phases;
+  (void)events;
+  return 0;
+#endif
+}
+
+/**
+ * Zeroes the counters. Not to be called while a calculation is running.
+ */
+void reset_profile(void) {
+#ifdef HFK_PROFILE
+  memset(profile_phases, 0, sizeof(profile_phases));
+  memset(profile_events, 0, sizeof(profile_events));
+#endif
+}
+
+/**
+ * Prints a table of the counters gathered so far. Prints nothing unless
+ * built with HFK_PROFILE.
+ * @param out the stream to print to
+ */
+void print_profile(FILE *out) {
+  ProfileCounter_t phases[PROFILE_PHASES];
+  unsigned long long events[PROFILE_EVENTS];
+  unsigned long long total = 0;
+
+  if (!get_profile(phases, events)) {
+    return;
+  }
+
+  for (int i = 0; i < PROFILE_PHASES; ++i) {
+    if (PROFILE_LOOKUP != i) {
+      total += phases[i].ticks;
+    }
+  }
+  fprintf(out, "%-12s %14s %18s %12s %7s\n", "phase", "calls", "ticks",
+          "ticks/call", "share");
+  for (int i = 0; i < PROFILE_PHASES; ++i) {
+    fprintf(out, "%-12s %14llu %18llu %12.1f %6.1f%%\n", phase_names[i],
+            phases[i].calls, phases[i].ticks,
+            phases[i].calls ? (double)phases[i].ticks / phases[i].calls : 0.0,
+            total ? 100.0 * phases[i].ticks / total : 0.0);
+  }
+  fprintf(out, "%-12s %14s\n", "event", "count");
+  for (int i = 0; i < PROFILE_EVENTS; ++i) {
+    fprintf(out, "%-12s %14llu\n", event_names[i], events[i]);
+  }
+}
+
+/**
+ * @param phase a ProfilePhase
+ * @return the name of phase
+ */
+const char *profile_phase_name(const int phase) { return phase_names[phase]; }
+
+/**
+ * @param event a ProfileEvent
+ * @return the name of event
+ */
+const char *profile_event_name(const int event) { return event_names[event]; }
@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#if defined(HFK_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(HFK_PROFILE)
+#include <time.h>
+#endif
+
+/**
+ * The phases timed when built with HFK_PROFILE. Phases nest: enumerating
+ * rectangles includes the lookups it makes and contracting includes every
+ * contract.
+ */
+enum ProfilePhase {
+  PROFILE_ENUMERATE,
+  PROFILE_LOOKUP,
+  PROFILE_SORT_EDGES,
+  PROFILE_CONTRACT,
+  PROFILE_PHASES
+};
+
+/**
+ * The events counted when built with HFK_PROFILE
+ */
+enum ProfileEvent {
+  PROFILE_RECTANGLES,
+  PROFILE_CANCELLED,
+  PROFILE_CONTRACTIONS,
+  PROFILE_EVENTS
+};
+
+struct ProfileCounter {
+  unsigned long long calls;
+  unsigned long long ticks;
+};
+
+typedef struct ProfileCounter ProfileCounter_t;
+
+#ifdef HFK_PROFILE
+
+extern ProfileCounter_t profile_phases[PROFILE_PHASES];
+extern unsigned long long profile_events[PROFILE_EVENTS];
+
+/**
+ * @return the cycle counter where there is one, nanoseconds otherwise
+ */
+static inline unsigned long long profile_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+#define PROFILE_START(start) const unsigned long long start = profile_ticks()
+#define PROFILE_STOP(phase, start)                                             \
+  do {                                                                         \
+    __atomic_add_fetch(&profile_phases[phase].calls, 1, __ATOMIC_RELAXED);     \
+    __atomic_add_fetch(&profile_phases[phase].ticks, profile_ticks() - start,  \
+                       __ATOMIC_RELAXED);                                      \
+  } while (0)
+#define PROFILE_EVENT(event, count)                                            \
+  __atomic_add_fetch(&profile_events[event], count, __ATOMIC_RELAXED)
+
+#else
+
+#define PROFILE_START(start)
+#define PROFILE_STOP(phase, start)
+#define PROFILE_EVENT(event, count)
+
+#endif
+
+int get_profile(ProfileCounter_t *, unsigned long long *);
+void reset_profile(void);
+void print_profile(FILE *);
+const char *profile_phase_name(const int);
+const char *profile_event_name(const int);
+
+#endif
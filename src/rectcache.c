@@ -0,0 +1,207 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rectcache.h"
+
+static RectangleEntry_t *find_entry(const RectangleCache_t *const,
+                                    const State);
+static void grow(RectangleCache_t *);
+
+/**
+ * Creates an empty cache of the rectangles out of and into the states of a
+ * single grid. The cache keeps a copy of the grid, since the rectangles of a
+ * state depend on it.
+ * @param G the grid
+ * @return a pointer to the cache
+ */
+RectangleCache_t *create_rectangle_cache(const Grid_t *const G) {
+  RectangleCache_t *cache = malloc(sizeof(RectangleCache_t));
+  cache->capacity = 1024;
+  cache->buckets = calloc(cache->capacity, sizeof(RectangleEntry_t *));
+  cache->count = 0;
+  cache->bytes = sizeof(RectangleCache_t) +
+                 cache->capacity * sizeof(RectangleEntry_t *) +
+                 2 * G->arc_index;
+  cache->key_len = G->arc_index;
+  cache->Xs = malloc(sizeof(char) * G->arc_index);
+  cache->Os = malloc(sizeof(char) * G->arc_index);
+  memcpy(cache->Xs, G->Xs, G->arc_index);
+  memcpy(cache->Os, G->Os, G->arc_index);
+  pthread_rwlock_init(&cache->lock, NULL);
+  return cache;
+}
+
+/**
+ * @param cache a RectangleCache
+ * @param G a grid
+ * @return nonzero if cache was created for G, so that its rectangles are
+ * those of the states of G
+ */
+int rectangle_cache_fits(const RectangleCache_t *const cache,
+                         const Grid_t *const G) {
+  return cache->key_len == G->arc_index &&
+         0 == memcmp(cache->Xs, G->Xs, G->arc_index) &&
+         0 == memcmp(cache->Os, G->Os, G->arc_index);
+}
+
+/**
+ * Looks up the rectangles of s. A rectangle is stored as the pair of
+ * positions of s it swaps, so pairs[2 * i] and pairs[2 * i + 1] are the
+ * i-th rectangle. The pairs stay valid until the cache is freed. May be
+ * called from several threads at once.
+ * @param cache a RectangleCache
+ * @param s a state
+ * @param direction RECTANGLES_OUT or RECTANGLES_INTO
+ * @param pairs destination for the pairs
+ * @return the number of rectangles, or -1 if they are not cached
+ */
+int rectangle_cache_get(RectangleCache_t *cache, const State s,
+                        const int direction, const unsigned short **pairs) {
+  int count = -1;
+
+  pthread_rwlock_rdlock(&cache->lock);
+  RectangleEntry_t *entry = find_entry(cache, s);
+  if (NULL != entry && NULL != entry->pairs[direction]) {
+    *pairs = entry->pairs[direction];
+    count = entry->counts[direction];
+  }
+  pthread_rwlock_unlock(&cache->lock);
+
+  return count;
+}
+
+/**
+ * Stores the rectangles of s. If another thread stored them first pairs is
+ * freed instead.
+ * @param cache a RectangleCache
+ * @param s a state, copied by the cache
+ * @param direction RECTANGLES_OUT or RECTANGLES_INTO
+ * @param pairs the swapped positions of each rectangle, owned by the cache
+ * @param count the number of rectangles
+ */
+void rectangle_cache_put(RectangleCache_t *cache, const State s,
+                         const int direction, unsigned short *pairs,
+                         const int count) {
+  pthread_rwlock_wrlock(&cache->lock);
+  RectangleEntry_t *entry = find_entry(cache, s);
+  if (NULL == entry) {
+    if (2 * cache->count >= cache->capacity) {
+      grow(cache);
+    }
+    const long i =
+        (long)(hash_state(s, cache->key_len) & (cache->capacity - 1));
+    entry = malloc(sizeof(RectangleEntry_t));
+    entry->key = malloc(sizeof(char) * cache->key_len);
+    memcpy(entry->key, s, cache->key_len);
+    entry->pairs[RECTANGLES_OUT] = NULL;
+    entry->pairs[RECTANGLES_INTO] = NULL;
+    entry->counts[RECTANGLES_OUT] = 0;
+    entry->counts[RECTANGLES_INTO] = 0;
+    entry->next = cache->buckets[i];
+    cache->buckets[i] = entry;
+    cache->count++;
+    __atomic_add_fetch(&cache->bytes,
+                       (long)sizeof(RectangleEntry_t) + cache->key_len,
+                       __ATOMIC_RELAXED);
+  }
+  if (NULL == entry->pairs[direction]) {
+    entry->pairs[direction] = pairs;
+    entry->counts[direction] = count;
+    __atomic_add_fetch(&cache->bytes,
+                       (long)(sizeof(unsigned short) * 2 * count),
+                       __ATOMIC_RELAXED);
+  } else {
+    free(pairs);
+  }
+  pthread_rwlock_unlock(&cache->lock);
+}
+
+/**
+ * May be called from several threads at once, while others fill cache.
+ * @param cache a RectangleCache
+ * @return the number of bytes taken by cache and the states and rectangles
+ * in it
+ */
+long rectangle_cache_bytes(const RectangleCache_t *const cache) {
+  return __atomic_load_n(&cache->bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees cache along with every state and rectangle in it
+ * @param cache a RectangleCache
+ */
+void free_rectangle_cache(RectangleCache_t *cache) {
+  for (long i = 0; i < cache->capacity; ++i) {
+    RectangleEntry_t *entry = cache->buckets[i];
+    while (NULL != entry) {
+      RectangleEntry_t *next = entry->next;
+      free(entry->key);
+      free(entry->pairs[RECTANGLES_OUT]);
+      free(entry->pairs[RECTANGLES_INTO]);
+      free(entry);
+      entry = next;
+    }
+  }
+  pthread_rwlock_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache->Xs);
+  free(cache->Os);
+  free(cache);
+}
+
+/**
+ * @param cache a RectangleCache, locked by the caller
+ * @param s a state
+ * @return the entry of s, or NULL if s is not in cache
+ */
+static RectangleEntry_t *find_entry(const RectangleCache_t *const cache,
+                                    const State s) {
+  const long i = (long)(hash_state(s, cache->key_len) & (cache->capacity - 1));
+  RectangleEntry_t *entry = cache->buckets[i];
+  while (NULL != entry && 0 != memcmp(entry->key, s, cache->key_len)) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+/**
+ * Doubles the number of buckets of cache
+ * @param cache a RectangleCache, write locked by the caller
+ */
+static void grow(RectangleCache_t *cache) {
+  const long capacity = 2 * cache->capacity;
+  RectangleEntry_t **buckets = calloc(capacity, sizeof(RectangleEntry_t *));
+
+  for (long i = 0; i < cache->capacity; ++i) {
+    RectangleEntry_t *entry = cache->buckets[i];
+    while (NULL != entry) {
+      RectangleEntry_t *next = entry->next;
+      const long j = (long)(hash_state(entry->key, cache->key_len) &
+                            (capacity - 1));
+      entry->next = buckets[j];
+      buckets[j] = entry;
+      entry = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  __atomic_add_fetch(&cache->bytes,
+                     (long)((capacity - cache->capacity) *
+                            sizeof(RectangleEntry_t *)),
+                     __ATOMIC_RELAXED);
+  cache->capacity = capacity;
+}
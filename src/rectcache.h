@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECTCACHE_H
+#define RECTCACHE_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashset.h"
+#include "states.h"
+
+#define RECTANGLES_OUT 0
+#define RECTANGLES_INTO 1
+
+typedef struct RectangleEntry RectangleEntry_t;
+
+struct RectangleEntry {
+  State key;
+  unsigned short *pairs[2];
+  int counts[2];
+  RectangleEntry_t *next;
+};
+
+struct RectangleCache {
+  RectangleEntry_t **buckets;
+  long capacity;
+  long count;
+  long bytes;
+  int key_len;
+  State Xs;
+  State Os;
+  pthread_rwlock_t lock;
+};
+
+typedef struct RectangleCache RectangleCache_t;
+
+RectangleCache_t *create_rectangle_cache(const Grid_t *const);
+int rectangle_cache_fits(const RectangleCache_t *const, const Grid_t *const);
+int rectangle_cache_get(RectangleCache_t *, const State, const int,
+                        const unsigned short **);
+void rectangle_cache_put(RectangleCache_t *, const State, const int,
+                         unsigned short *, const int);
+long rectangle_cache_bytes(const RectangleCache_t *const);
+void free_rectangle_cache(RectangleCache_t *);
+
+#endif
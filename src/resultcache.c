@@ -0,0 +1,248 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resultcache.h"
+
+static ResultEntry_t *find_entry(const ResultCache_t *const, const char *);
+static void insert_entry(ResultCache_t *, const char *, const int);
+static void grow(ResultCache_t *);
+
+/**
+ * Creates an empty result cache that is only kept in memory
+ * @return a pointer to the cache
+ */
+ResultCache_t *create_result_cache(void) {
+  ResultCache_t *cache = malloc(sizeof(ResultCache_t));
+  cache->capacity = 1024;
+  cache->buckets = calloc(cache->capacity, sizeof(ResultEntry_t *));
+  cache->count = 0;
+  cache->file = NULL;
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+/**
+ * Opens the result cache kept in the file at path, creating it if needed,
+ * and loads the results it holds. The file is a line holding
+ * RESULT_CACHE_VERSION followed by one line per result: the key given by
+ * result_key, a space, and 1 or 0. New results are appended, so several
+ * processes may share the file.
+ * @param path the file of the cache
+ * @return a pointer to the cache, or NULL if the file cannot be opened
+ */
+ResultCache_t *open_result_cache(const char *path) {
+  FILE *file = fopen(path, "a+");
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+
+  if (NULL == file) {
+    return NULL;
+  }
+
+  ResultCache_t *cache = create_result_cache();
+  cache->file = file;
+
+  // Held while the version is checked, so that of several processes finding
+  // an old file only the first starts it over and the others load its stamp
+  flock(fileno(file), LOCK_EX);
+  rewind(file);
+  len = getline(&line, &line_size, file);
+  if (len <= 0 || 0 != strcmp(line, RESULT_CACHE_VERSION "\n")) {
+    // Empty, or written by another version: start over. Truncating in place
+    // keeps the file in append mode for the processes sharing it.
+    if (0 != ftruncate(fileno(file), 0)) {
+      free(line);
+      close_result_cache(cache);
+      return NULL;
+    }
+    rewind(file);
+    fprintf(file, "%s\n", RESULT_CACHE_VERSION);
+    fflush(file);
+  } else {
+    while (-1 != (len = getline(&line, &line_size, file))) {
+      char *result = strrchr(line, ' ');
+      if (NULL == result || (result[1] != '0' && result[1] != '1')) {
+        continue;
+      }
+      *result = '\0';
+      if (NULL == find_entry(cache, line)) {
+        insert_entry(cache, line, result[1] - '0');
+      }
+    }
+  }
+  flock(fileno(file), LOCK_UN);
+  free(line);
+
+  return cache;
+}
+
+/**
+ * Builds the key of an invariant of a grid. The key describes the canonical
+ * grid of the grid, so translations of a grid share their keys.
+ * @param Xs the Xs of the grid
+ * @param Os the Os of the grid
+ * @param arc_index the arc index of the grid
+ * @param sheets the number of sheets of the cover, 1 for the grid itself
+ * @param invariant the name of the invariant
+ * @return the key, to be freed by the caller
+ */
+char *result_key(const State Xs, const State Os, const int arc_index,
+                 const int sheets, const char *invariant) {
+  // Each entry takes at most 3 digits and a comma
+  char *key = malloc(sizeof(char) * (8 * arc_index + strlen(invariant) + 32));
+  int len = sprintf(key, "%d %d ", arc_index, sheets);
+  Grid_t G = {Xs, Os, arc_index}, canon;
+
+  canonical_grid(&canon, NULL, NULL, &G);
+  for (int i = 0; i < arc_index; ++i) {
+    len += sprintf(&key[len], (0 == i) ? "%d" : ",%d", canon.Xs[i]);
+  }
+  key[len++] = ' ';
+  for (int i = 0; i < arc_index; ++i) {
+    len += sprintf(&key[len], (0 == i) ? "%d" : ",%d", canon.Os[i]);
+  }
+  sprintf(&key[len], " %s", invariant);
+  free(canon.Xs);
+  free(canon.Os);
+
+  return key;
+}
+
+/**
+ * Looks up a result. May be called from several threads at once.
+ * @param cache a ResultCache
+ * @param key a key built by result_key
+ * @return 1 if null-homologous, 0 if not, and -1 if the result is not cached
+ */
+int result_cache_get(ResultCache_t *cache, const char *key) {
+  int result = -1;
+
+  pthread_mutex_lock(&cache->lock);
+  ResultEntry_t *entry = find_entry(cache, key);
+  if (NULL != entry) {
+    result = entry->result;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return result;
+}
+
+/**
+ * Stores a result and appends it to the file of the cache, if it has one.
+ * Each result is written with a single write, so lines from other processes
+ * sharing the file are not interleaved with it. May be called from several
+ * threads at once.
+ * @param cache a ResultCache
+ * @param key a key built by result_key
+ * @param result 1 if null-homologous, 0 if not
+ */
+void result_cache_put(ResultCache_t *cache, const char *key,
+                      const int result) {
+  pthread_mutex_lock(&cache->lock);
+  if (NULL == find_entry(cache, key)) {
+    insert_entry(cache, key, result);
+    if (NULL != cache->file) {
+      fprintf(cache->file, "%s %d\n", key, result);
+      fflush(cache->file);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Closes the file of cache and frees it along with every result in it
+ * @param cache a ResultCache
+ */
+void close_result_cache(ResultCache_t *cache) {
+  for (long i = 0; i < cache->capacity; ++i) {
+    ResultEntry_t *entry = cache->buckets[i];
+    while (NULL != entry) {
+      ResultEntry_t *next = entry->next;
+      free(entry->key);
+      free(entry);
+      entry = next;
+    }
+  }
+  if (NULL != cache->file) {
+    fclose(cache->file);
+  }
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache);
+}
+
+/**
+ * @param cache a ResultCache, locked by the caller
+ * @param key a key
+ * @return the entry of key, or NULL if key is not in cache
+ */
+static ResultEntry_t *find_entry(const ResultCache_t *const cache,
+                                 const char *key) {
+  const long i = (long)(hash_state((State)key, strlen(key)) &
+                        (cache->capacity - 1));
+  ResultEntry_t *entry = cache->buckets[i];
+  while (NULL != entry && 0 != strcmp(entry->key, key)) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+/**
+ * Adds a result that is not in cache yet
+ * @param cache a ResultCache, locked by the caller
+ * @param key a key, copied by the cache
+ * @param result 1 if null-homologous, 0 if not
+ */
+static void insert_entry(ResultCache_t *cache, const char *key,
+                         const int result) {
+  if (2 * cache->count >= cache->capacity) {
+    grow(cache);
+  }
+  const long i = (long)(hash_state((State)key, strlen(key)) &
+                        (cache->capacity - 1));
+  ResultEntry_t *entry = malloc(sizeof(ResultEntry_t));
+  entry->key = strdup(key);
+  entry->result = result;
+  entry->next = cache->buckets[i];
+  cache->buckets[i] = entry;
+  cache->count++;
+}
+
+/**
+ * Doubles the number of buckets of cache
+ * @param cache a ResultCache, locked by the caller
+ */
+static void grow(ResultCache_t *cache) {
+  const long capacity = 2 * cache->capacity;
+  ResultEntry_t **buckets = calloc(capacity, sizeof(ResultEntry_t *));
+
+  for (long i = 0; i < cache->capacity; ++i) {
+    ResultEntry_t *entry = cache->buckets[i];
+    while (NULL != entry) {
+      ResultEntry_t *next = entry->next;
+      const long j = (long)(hash_state(entry->key, strlen(entry->key)) &
+                            (capacity - 1));
+      entry->next = buckets[j];
+      buckets[j] = entry;
+      entry = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->capacity = capacity;
+}
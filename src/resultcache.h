@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "hashset.h"
+#include "states.h"
+
+/**
+ * The first line of a result cache file. Files starting with anything else
+ * were written by an incompatible version and are started over. Change it
+ * whenever the key or the meaning of a result changes.
+ */
+#define RESULT_CACHE_VERSION "transverseHFK result cache 2"
+
+typedef struct ResultEntry ResultEntry_t;
+
+struct ResultEntry {
+  char *key;
+  int result;
+  ResultEntry_t *next;
+};
+
+struct ResultCache {
+  FILE *file;
+  ResultEntry_t **buckets;
+  long capacity;
+  long count;
+  pthread_mutex_t lock;
+};
+
+typedef struct ResultCache ResultCache_t;
+
+ResultCache_t *create_result_cache(void);
+ResultCache_t *open_result_cache(const char *);
+char *result_key(const State, const State, const int, const int,
+                 const char *);
+int result_cache_get(ResultCache_t *, const char *);
+void result_cache_put(ResultCache_t *, const char *, const int);
+void close_result_cache(ResultCache_t *);
+
+#endif
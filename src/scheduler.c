@@ -0,0 +1,243 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scheduler.h"
+
+static void *worker_main(void *);
+static void work(Scheduler_t *, const int);
+static int pop_item(Scheduler_t *, const int);
+static int steal_items(Scheduler_t *, const int);
+
+/**
+ * Creates a work-stealing scheduler with the supplied number of workers.
+ * The calling thread acts as worker 0 so workers - 1 threads are started.
+ * @param workers the number of workers, at least 1
+ * @return a pointer to the scheduler
+ */
+Scheduler_t *create_scheduler(const int workers) {
+  Scheduler_t *s = malloc(sizeof(Scheduler_t));
+  s->workers = workers;
+  s->threads = malloc(sizeof(pthread_t) * workers);
+  s->args = malloc(sizeof(struct WorkerArg) * workers);
+  s->deques = malloc(sizeof(WorkerDeque_t) * workers);
+  s->stats = calloc(workers, sizeof(WorkerStats_t));
+  s->generation = 0;
+  s->running = 0;
+  s->shutdown = 0;
+  s->task = NULL;
+  s->data = NULL;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->wake, NULL);
+  pthread_cond_init(&s->done, NULL);
+
+  for (int i = 0; i < workers; ++i) {
+    pthread_mutex_init(&s->deques[i].lock, NULL);
+    s->deques[i].lo = 0;
+    s->deques[i].hi = 0;
+    s->args[i].scheduler = s;
+    s->args[i].id = i;
+  }
+
+  for (int i = 1; i < workers; ++i) {
+    pthread_create(&s->threads[i], NULL, worker_main, &s->args[i]);
+  }
+
+  return s;
+}
+
+/**
+ * Runs task on every item in [0, n) and returns once all of them are done.
+ * The items are split evenly between the workers' deques. A worker takes
+ * items from the front of its own deque and once it is empty steals the back
+ * half of another worker's deque.
+ * @param s a scheduler
+ * @param n the number of items
+ * @param task called as task(item, worker, data)
+ * @param data passed through to task
+ */
+void run_tasks(Scheduler_t *s, const int n, task_fn task, void *data) {
+  if (n <= 0) {
+    return;
+  }
+
+  for (int i = 0; i < s->workers; ++i) {
+    pthread_mutex_lock(&s->deques[i].lock);
+    s->deques[i].lo = (int)(((long)n * i) / s->workers);
+    s->deques[i].hi = (int)(((long)n * (i + 1)) / s->workers);
+    pthread_mutex_unlock(&s->deques[i].lock);
+  }
+
+  pthread_mutex_lock(&s->lock);
+  s->task = task;
+  s->data = data;
+  s->running = s->workers - 1;
+  s->generation++;
+  pthread_cond_broadcast(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+
+  work(s, 0);
+
+  pthread_mutex_lock(&s->lock);
+  while (s->running > 0) {
+    pthread_cond_wait(&s->done, &s->lock);
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Zeroes the per worker counters of s
+ * @param s a scheduler
+ */
+void reset_worker_stats(Scheduler_t *s) {
+  for (int i = 0; i < s->workers; ++i) {
+    s->stats[i].tasks = 0;
+    s->stats[i].steals = 0;
+    s->stats[i].stolen = 0;
+  }
+}
+
+/**
+ * Stops the worker threads of s and frees it
+ * @param s a scheduler
+ */
+void free_scheduler(Scheduler_t *s) {
+  pthread_mutex_lock(&s->lock);
+  s->shutdown = 1;
+  pthread_cond_broadcast(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+
+  for (int i = 1; i < s->workers; ++i) {
+    pthread_join(s->threads[i], NULL);
+  }
+
+  for (int i = 0; i < s->workers; ++i) {
+    pthread_mutex_destroy(&s->deques[i].lock);
+  }
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->wake);
+  pthread_cond_destroy(&s->done);
+  free(s->threads);
+  free(s->args);
+  free(s->deques);
+  free(s->stats);
+  free(s);
+}
+
+/**
+ * Body of the worker threads. Sleeps until run_tasks starts a new round of
+ * items or the scheduler is shut down.
+ * @param arg a struct WorkerArg
+ */
+static void *worker_main(void *arg) {
+  Scheduler_t *s = ((struct WorkerArg *)arg)->scheduler;
+  const int id = ((struct WorkerArg *)arg)->id;
+  int seen = 0;
+
+  pthread_mutex_lock(&s->lock);
+  for (;;) {
+    while (!s->shutdown && s->generation == seen) {
+      pthread_cond_wait(&s->wake, &s->lock);
+    }
+    if (s->shutdown) {
+      break;
+    }
+    seen = s->generation;
+    pthread_mutex_unlock(&s->lock);
+
+    work(s, id);
+
+    pthread_mutex_lock(&s->lock);
+    if (0 == --s->running) {
+      pthread_cond_signal(&s->done);
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+/**
+ * Processes items until neither the worker's own deque nor any other deque
+ * has any left.
+ * @param s a scheduler
+ * @param id the worker
+ */
+static void work(Scheduler_t *s, const int id) {
+  for (;;) {
+    int item = pop_item(s, id);
+    if (item < 0) {
+      if (steal_items(s, id)) {
+        continue;
+      }
+      break;
+    }
+    s->task(item, id, s->data);
+    s->stats[id].tasks++;
+  }
+}
+
+/**
+ * Takes the item at the front of the worker's deque
+ * @param s a scheduler
+ * @param id the worker
+ * @return the item, or -1 if the deque is empty
+ */
+static int pop_item(Scheduler_t *s, const int id) {
+  WorkerDeque_t *d = &s->deques[id];
+  int item = -1;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->lo < d->hi) {
+    item = d->lo++;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return item;
+}
+
+/**
+ * Moves the back half of the first nonempty deque after the worker's own into
+ * the worker's deque.
+ * @param s a scheduler
+ * @param id the worker
+ * @return 1 if anything was stolen, 0 if every deque is empty
+ */
+static int steal_items(Scheduler_t *s, const int id) {
+  for (int k = 1; k < s->workers; ++k) {
+    WorkerDeque_t *victim = &s->deques[(id + k) % s->workers];
+    int lo = 0, hi = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->lo < victim->hi) {
+      hi = victim->hi;
+      lo = hi - (victim->hi - victim->lo + 1) / 2;
+      victim->hi = lo;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (lo < hi) {
+      WorkerDeque_t *own = &s->deques[id];
+      pthread_mutex_lock(&own->lock);
+      own->lo = lo;
+      own->hi = hi;
+      pthread_mutex_unlock(&own->lock);
+      s->stats[id].steals++;
+      s->stats[id].stolen += hi - lo;
+      return 1;
+    }
+  }
+  return 0;
+}
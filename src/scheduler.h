@@ -0,0 +1,71 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "alloctrack.h"
+
+typedef void (*task_fn)(const int, const int, void *);
+
+struct WorkerStats {
+  long tasks;
+  long steals;
+  long stolen;
+};
+
+typedef struct WorkerStats WorkerStats_t;
+
+struct WorkerDeque {
+  pthread_mutex_t lock;
+  int lo;
+  int hi;
+};
+
+typedef struct WorkerDeque WorkerDeque_t;
+
+typedef struct Scheduler Scheduler_t;
+
+struct WorkerArg {
+  Scheduler_t *scheduler;
+  int id;
+};
+
+struct Scheduler {
+  int workers;
+  pthread_t *threads;
+  struct WorkerArg *args;
+  WorkerDeque_t *deques;
+  WorkerStats_t *stats;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  int generation;
+  int running;
+  int shutdown;
+  task_fn task;
+  void *data;
+};
+
+Scheduler_t *create_scheduler(const int);
+void run_tasks(Scheduler_t *, const int, task_fn, void *);
+void reset_worker_stats(Scheduler_t *);
+void free_scheduler(Scheduler_t *);
+
+#endif
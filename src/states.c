@@ -16,12 +16,17 @@
 
 #include "states.h"
 
-LiftStateRBTreeNode_t NIL_LIFT_NODE = {
-    BLACK, -1, NULL, &NIL_LIFT_NODE, &NIL_LIFT_NODE, &NIL_LIFT_NODE};
-LiftStateRBTree EMPTY_LIFT_TREE = &NIL_LIFT_NODE;
+// The sentinels are shared by every tree in the process, so they are const
+// and any write to them faults instead of racing with other calculations.
+const LiftStateRBTreeNode_t NIL_LIFT_NODE = {
+    BLACK, -1, NULL, (LiftStateRBTree)&NIL_LIFT_NODE,
+    (LiftStateRBTree)&NIL_LIFT_NODE, (LiftStateRBTree)&NIL_LIFT_NODE};
+LiftStateRBTree const EMPTY_LIFT_TREE = (LiftStateRBTree)&NIL_LIFT_NODE;
 
-StateRBTreeNode_t NIL_NODE = {BLACK, -1, NULL, &NIL_NODE, &NIL_NODE, &NIL_NODE};
-StateRBTree EMPTY_TREE = &NIL_NODE;
+const StateRBTreeNode_t NIL_NODE = {BLACK, -1, NULL, (StateRBTree)&NIL_NODE,
+                                    (StateRBTree)&NIL_NODE,
+                                    (StateRBTree)&NIL_NODE};
+StateRBTree const EMPTY_TREE = (StateRBTree)&NIL_NODE;
 
 /**
  * Allocates memory for the supplied lift state
@@ -288,6 +293,71 @@ LiftGrid_t *mirror_lift_grid(const LiftGrid_t *const G) {
   return G_mirror;
 }
 
+/**
+ * Translates s across the torus the grid lives on: column i of dest is
+ * column i + cols of s, raised by rows, both mod n. Applied to the Xs and Os
+ * of a grid it gives the translated grid, and applied to the x^- or x^+
+ * state of a grid it gives the x^- or x^+ state of the translated grid.
+ * @param dest destination for the translated state
+ * @param s a state, or the Xs or Os of a grid
+ * @param cols the number of columns to shift by
+ * @param rows the number of rows to shift by
+ * @param n the arc index
+ */
+void translate_state(State dest, const State s, const int cols, const int rows,
+                     const int n) {
+  for (int i = 0; i < n; ++i) {
+    dest[i] = (char)((s[(i + cols) % n] - 1 + rows) % n + 1);
+  }
+}
+
+/**
+ * Finds the translation of G whose Xs followed by its Os are
+ * lexicographically smallest. Translated grids are Legendrian isotopic with
+ * their distinguished states translated along, so every grid a translation
+ * of another has the same canonical grid and the same invariants.
+ * @param dest filled with the canonical grid, whose Xs and Os are allocated
+ * by this function
+ * @param cols set to the number of columns G is shifted by, may be NULL
+ * @param rows set to the number of rows G is shifted by, may be NULL
+ * @param G a grid
+ */
+void canonical_grid(Grid_t *dest, int *cols, int *rows,
+                    const Grid_t *const G) {
+  const int n = G->arc_index;
+  char *best = malloc(sizeof(char) * 2 * n);
+  char *candidate = malloc(sizeof(char) * 2 * n);
+  int best_cols = 0, best_rows = 0;
+
+  memcpy(best, G->Xs, n);
+  memcpy(&best[n], G->Os, n);
+  for (int c = 0; c < n; ++c) {
+    for (int r = 0; r < n; ++r) {
+      translate_state(candidate, G->Xs, c, r, n);
+      translate_state(&candidate[n], G->Os, c, r, n);
+      if (memcmp(candidate, best, 2 * n) < 0) {
+        memcpy(best, candidate, 2 * n);
+        best_cols = c;
+        best_rows = r;
+      }
+    }
+  }
+
+  dest->arc_index = n;
+  dest->Xs = malloc(sizeof(char) * n);
+  dest->Os = malloc(sizeof(char) * n);
+  memcpy(dest->Xs, best, n);
+  memcpy(dest->Os, &best[n], n);
+  if (NULL != cols) {
+    *cols = best_cols;
+  }
+  if (NULL != rows) {
+    *rows = best_rows;
+  }
+  free(best);
+  free(candidate);
+}
+
 /**
  * Computes the writhe of the passed grid
  * @param G working grid
@@ -788,6 +858,8 @@ void insert_fixup(LiftStateRBTree *root, LiftStateRBTree z) {
  * @param root the root of the RBTree
  * @param u a descendant node of root
  * @param v a descendant node of root
+ * @warning does not update the parent of v when v is EMPTY_LIFT_TREE so that
+ * the sentinel is never written to
  */
 void transplant(LiftStateRBTree *root, LiftStateRBTree u, LiftStateRBTree v) {
   if (EMPTY_LIFT_TREE == u->parent) {
@@ -797,7 +869,9 @@ void transplant(LiftStateRBTree *root, LiftStateRBTree u, LiftStateRBTree v) {
   } else {
     u->parent->right = v;
   }
-  v->parent = u->parent;
+  if (EMPTY_LIFT_TREE != v) {
+    v->parent = u->parent;
+  }
 }
 
 /**
@@ -808,21 +882,25 @@ void transplant(LiftStateRBTree *root, LiftStateRBTree u, LiftStateRBTree v) {
 void delete_node(LiftStateRBTree *root, LiftStateRBTree z) {
   LiftStateRBTree y = z;
   LiftStateRBTree x;
+  LiftStateRBTree x_parent;
   int y_original_color = y->color;
 
   if (EMPTY_LIFT_TREE == z->left) {
     x = z->right;
+    x_parent = z->parent;
     transplant(root, z, z->right);
   } else if (EMPTY_LIFT_TREE == z->right) {
     x = z->left;
+    x_parent = z->parent;
     transplant(root, z, z->left);
   } else {
     y = find_minimum_node(&z->right);
     y_original_color = y->color;
     x = y->right;
     if (y->parent == z) {
-      x->parent = y;
+      x_parent = y;
     } else {
+      x_parent = y->parent;
       transplant(root, y, y->right);
       y->right = z->right;
       y->right->parent = y;
@@ -833,67 +911,74 @@ void delete_node(LiftStateRBTree *root, LiftStateRBTree z) {
     y->color = z->color;
   }
   if (BLACK == y_original_color) {
-    delete_fixup(root, x);
+    delete_fixup(root, x, x_parent);
   }
 }
 
 /**
- * Repairs root after a delete
+ * Repairs root after a delete. The parent of x is passed explicitly since x
+ * may be the shared sentinel, whose fields are never modified.
  * @param root the root of the RBTree
  * @param x the node to be repaired about
+ * @param parent the parent of x
  */
-void delete_fixup(LiftStateRBTree *root, LiftStateRBTree x) {
+void delete_fixup(LiftStateRBTree *root, LiftStateRBTree x,
+                  LiftStateRBTree parent) {
   while (x != *root && x->color == BLACK) {
     LiftStateRBTree w;
-    if (x == x->parent->left) {
-      w = x->parent->right;
+    if (x == parent->left) {
+      w = parent->right;
       if (RED == w->color) {
         w->color = BLACK;
-        x->parent->color = RED;
-        left_rotate(root, x->parent);
-        w = x->parent->right;
+        parent->color = RED;
+        left_rotate(root, parent);
+        w = parent->right;
       }
       if (BLACK == w->left->color && BLACK == w->right->color) {
         w->color = RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else if (BLACK == w->right->color) {
         w->left->color = BLACK;
         w->color = RED;
         right_rotate(root, w);
-        w = x->parent->right;
+        w = parent->right;
       } else {
-        w->color = x->parent->color;
-        x->parent->color = BLACK;
+        w->color = parent->color;
+        parent->color = BLACK;
         w->right->color = BLACK;
-        left_rotate(root, x->parent);
+        left_rotate(root, parent);
         x = *root;
       }
     } else {
-      w = x->parent->left;
+      w = parent->left;
       if (RED == w->color) {
         w->color = BLACK;
-        x->parent->color = RED;
-        right_rotate(root, x->parent);
-        w = x->parent->left;
+        parent->color = RED;
+        right_rotate(root, parent);
+        w = parent->left;
       }
       if (BLACK == w->left->color && BLACK == w->right->color) {
         w->color = RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else if (BLACK == w->left->color) {
         w->right->color = BLACK;
         w->color = RED;
         left_rotate(root, w);
-        w = x->parent->left;
+        w = parent->left;
       } else {
-        w->color = x->parent->color;
-        x->parent->color = BLACK;
+        w->color = parent->color;
+        parent->color = BLACK;
         w->left->color = BLACK;
-        right_rotate(root, x->parent);
+        right_rotate(root, parent);
         x = *root;
       }
     }
   }
-  x->color = BLACK;
+  if (EMPTY_LIFT_TREE != x) {
+    x->color = BLACK;
+  }
 }
 
 /**
@@ -977,11 +1062,12 @@ LiftState find_maximum(LiftStateRBTree *root) {
  */
 LiftStateRBTree find_node(const LiftStateRBTree *const root, LiftState s,
                           const LiftGrid_t *const G) {
+  PROFILE_START(start);
   LiftStateRBTree iter = *root;
   while (iter != EMPTY_LIFT_TREE) {
     int comp = comp_lift_state(s, iter->data, G);
     if (0 == comp) {
-      return iter;
+      break;
     } else if (comp < 0) {
       iter = iter->left;
     } else {
@@ -989,7 +1075,8 @@ LiftStateRBTree find_node(const LiftStateRBTree *const root, LiftState s,
     }
   }
 
-  return EMPTY_LIFT_TREE;
+  PROFILE_STOP(PROFILE_LOOKUP, start);
+  return iter;
 }
 
 /**
@@ -1299,6 +1386,8 @@ void s_insert_fixup(StateRBTree *root, StateRBTree z) {
  * @param root the root of the RBTree
  * @param u a descendant node of root
  * @param v a descendant node of root
+ * @warning does not update the parent of v when v is EMPTY_TREE so that the
+ * sentinel is never written to
  */
 void s_transplant(StateRBTree *root, StateRBTree u, StateRBTree v) {
   if (EMPTY_TREE == u->parent) {
@@ -1308,7 +1397,9 @@ void s_transplant(StateRBTree *root, StateRBTree u, StateRBTree v) {
   } else {
     u->parent->right = v;
   }
-  v->parent = u->parent;
+  if (EMPTY_TREE != v) {
+    v->parent = u->parent;
+  }
 }
 
 /**
@@ -1319,21 +1410,25 @@ void s_transplant(StateRBTree *root, StateRBTree u, StateRBTree v) {
 void s_delete_node(StateRBTree *root, StateRBTree z) {
   StateRBTree y = z;
   StateRBTree x;
+  StateRBTree x_parent;
   int y_original_color = y->color;
 
   if (EMPTY_TREE == z->left) {
     x = z->right;
+    x_parent = z->parent;
     s_transplant(root, z, z->right);
   } else if (EMPTY_TREE == z->right) {
     x = z->left;
+    x_parent = z->parent;
     s_transplant(root, z, z->left);
   } else {
     y = s_find_minimum_node(&z->right);
     y_original_color = y->color;
     x = y->right;
     if (y->parent == z) {
-      x->parent = y;
+      x_parent = y;
     } else {
+      x_parent = y->parent;
       s_transplant(root, y, y->right);
       y->right = z->right;
       y->right->parent = y;
@@ -1344,67 +1439,73 @@ void s_delete_node(StateRBTree *root, StateRBTree z) {
     y->color = z->color;
   }
   if (BLACK == y_original_color) {
-    s_delete_fixup(root, x);
+    s_delete_fixup(root, x, x_parent);
   }
 }
 
 /**
- * Repairs root after a delete
+ * Repairs root after a delete. The parent of x is passed explicitly since x
+ * may be the shared sentinel, whose fields are never modified.
  * @param root the root of the RBTree
  * @param x the node to be repaired about
+ * @param parent the parent of x
  */
-void s_delete_fixup(StateRBTree *root, StateRBTree x) {
+void s_delete_fixup(StateRBTree *root, StateRBTree x, StateRBTree parent) {
   while (x != *root && x->color == BLACK) {
     StateRBTree w;
-    if (x == x->parent->left) {
-      w = x->parent->right;
+    if (x == parent->left) {
+      w = parent->right;
       if (RED == w->color) {
         w->color = BLACK;
-        x->parent->color = RED;
-        s_left_rotate(root, x->parent);
-        w = x->parent->right;
+        parent->color = RED;
+        s_left_rotate(root, parent);
+        w = parent->right;
       }
       if (BLACK == w->left->color && BLACK == w->right->color) {
         w->color = RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else if (BLACK == w->right->color) {
         w->left->color = BLACK;
         w->color = RED;
         s_right_rotate(root, w);
-        w = x->parent->right;
+        w = parent->right;
       } else {
-        w->color = x->parent->color;
-        x->parent->color = BLACK;
+        w->color = parent->color;
+        parent->color = BLACK;
         w->right->color = BLACK;
-        s_left_rotate(root, x->parent);
+        s_left_rotate(root, parent);
         x = *root;
       }
     } else {
-      w = x->parent->left;
+      w = parent->left;
       if (RED == w->color) {
         w->color = BLACK;
-        x->parent->color = RED;
-        s_right_rotate(root, x->parent);
-        w = x->parent->left;
+        parent->color = RED;
+        s_right_rotate(root, parent);
+        w = parent->left;
       }
       if (BLACK == w->left->color && BLACK == w->right->color) {
         w->color = RED;
-        x = x->parent;
+        x = parent;
+        parent = x->parent;
       } else if (BLACK == w->left->color) {
         w->right->color = BLACK;
         w->color = RED;
         s_left_rotate(root, w);
-        w = x->parent->left;
+        w = parent->left;
       } else {
-        w->color = x->parent->color;
-        x->parent->color = BLACK;
+        w->color = parent->color;
+        parent->color = BLACK;
         w->left->color = BLACK;
-        s_right_rotate(root, x->parent);
+        s_right_rotate(root, parent);
         x = *root;
       }
     }
   }
-  x->color = BLACK;
+  if (EMPTY_TREE != x) {
+    x->color = BLACK;
+  }
 }
 
 /**
@@ -1487,11 +1588,12 @@ State s_find_maximum(StateRBTree *root) {
  */
 StateRBTree s_find_node(const StateRBTree *const root, State s,
                         const Grid_t *const G) {
+  PROFILE_START(start);
   StateRBTree iter = *root;
   while (iter != EMPTY_TREE) {
     int comp = comp_state(s, iter->data, G);
     if (0 == comp) {
-      return iter;
+      break;
     } else if (comp < 0) {
       iter = iter->left;
     } else {
@@ -1499,7 +1601,8 @@ StateRBTree s_find_node(const StateRBTree *const root, State s,
     }
   }
 
-  return EMPTY_TREE;
+  PROFILE_STOP(PROFILE_LOOKUP, start);
+  return iter;
 }
 
 /**
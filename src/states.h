@@ -20,6 +20,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloctrack.h"
+#include "profile.h"
+
 #define BLACK 0
 #define RED 1
 
@@ -55,8 +58,8 @@ struct LiftStateRBTreeNode {
   LiftStateRBTree parent;
 };
 
-LiftStateRBTreeNode_t NIL_LIFT_NODE;
-LiftStateRBTree EMPTY_LIFT_TREE;
+extern const LiftStateRBTreeNode_t NIL_LIFT_NODE;
+extern LiftStateRBTree const EMPTY_LIFT_TREE;
 
 typedef struct LiftTreeListNode LiftTreeListNode_t;
 typedef LiftTreeListNode_t *LiftTreeList;
@@ -85,8 +88,8 @@ struct StateRBTreeNode {
   StateRBTree parent;
 };
 
-StateRBTreeNode_t NIL_NODE;
-StateRBTree EMPTY_TREE;
+extern const StateRBTreeNode_t NIL_NODE;
+extern StateRBTree const EMPTY_TREE;
 
 typedef struct TreeListNode TreeListNode_t;
 typedef TreeListNode_t *TreeList;
@@ -157,6 +160,8 @@ int comp_lift_state(const LiftState, const LiftState,
 int is_grid(const Grid_t *const);
 int is_lift_grid(const LiftGrid_t *const);
 LiftGrid_t *mirror_lift_grid(const LiftGrid_t *const);
+void translate_state(State, const State, const int, const int, const int);
+void canonical_grid(Grid_t *, int *, int *, const Grid_t *const);
 int get_writhe(const Grid_t *const);
 void cusps(int *, const Grid_t *const);
 
@@ -183,7 +188,7 @@ void insert_node(LiftStateRBTree *, LiftStateRBTree, const LiftGrid_t *const);
 void insert_fixup(LiftStateRBTree *, LiftStateRBTree);
 void transplant(LiftStateRBTree *, LiftStateRBTree, LiftStateRBTree);
 void delete_node(LiftStateRBTree *, LiftStateRBTree);
-void delete_fixup(LiftStateRBTree *, LiftStateRBTree);
+void delete_fixup(LiftStateRBTree *, LiftStateRBTree, LiftStateRBTree);
 void delete_data(LiftStateRBTree *, LiftState, const LiftGrid_t *const);
 LiftStateRBTree find_minimum_node(LiftStateRBTree *);
 LiftStateRBTree find_maximum_node(LiftStateRBTree *);
@@ -209,7 +214,7 @@ void s_insert_node(StateRBTree *, StateRBTree, const Grid_t *const);
 void s_insert_fixup(StateRBTree *, StateRBTree);
 void s_transplant(StateRBTree *, StateRBTree, StateRBTree);
 void s_delete_node(StateRBTree *, StateRBTree);
-void s_delete_fixup(StateRBTree *, StateRBTree);
+void s_delete_fixup(StateRBTree *, StateRBTree, StateRBTree);
 void s_delete_data(StateRBTree *, State, const Grid_t *const);
 StateRBTree s_find_minimum_node(StateRBTree *);
 StateRBTree s_find_maximum_node(StateRBTree *);
@@ -0,0 +1,159 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "statetable.h"
+#include "hashset.h"
+
+static long find_slot(const StateTable_t *const, const State, int *);
+static void grow_slots(StateTable_t *);
+
+/**
+ * Creates an empty interning table for states of length key_len. Each state
+ * added is copied once into a single growing array and given the next of
+ * the IDs 1, 2, ..., which is its position in that array. The slots of the
+ * hash table hold IDs rather than pointers, so a state takes key_len chars
+ * and a couple of ints.
+ * @param key_len the number of chars in each state
+ * @return a pointer to the table
+ */
+StateTable_t *create_state_table(const int key_len) {
+  StateTable_t *table = malloc(sizeof(StateTable_t));
+  table->capacity = 16;
+  table->slots = calloc(table->capacity, sizeof(int));
+  table->room = 8;
+  table->states = malloc(sizeof(char) * table->room * key_len);
+  table->count = 0;
+  table->key_len = key_len;
+  return table;
+}
+
+/**
+ * Adds a copy of s to table unless an equal state is already present
+ * @param table a StateTable
+ * @param s a state, left with the caller
+ * @param id destination for the ID of s in table
+ * @return 1 if s was added and 0 if an equal state was already present
+ */
+int state_table_intern(StateTable_t *table, const State s, int *id) {
+  PROFILE_START(start);
+  long i = find_slot(table, s, id);
+
+  if (0 != *id) {
+    PROFILE_STOP(PROFILE_LOOKUP, start);
+    return 0;
+  }
+  if (2 * (long)(table->count + 1) > table->capacity) {
+    grow_slots(table);
+    i = find_slot(table, s, id);
+  }
+  if (table->count == table->room) {
+    table->room *= 2;
+    table->states =
+        realloc(table->states, sizeof(char) * table->room * table->key_len);
+  }
+  *id = ++table->count;
+  memcpy(&table->states[(long)(*id - 1) * table->key_len], s,
+         table->key_len);
+  table->slots[i] = *id;
+  PROFILE_STOP(PROFILE_LOOKUP, start);
+  return 1;
+}
+
+/**
+ * Looks up the ID of s in table
+ * @param table a StateTable
+ * @param s a state
+ * @return the ID of s, or 0 if s is not in table
+ */
+int state_table_id(const StateTable_t *const table, const State s) {
+  PROFILE_START(start);
+  int id;
+  find_slot(table, s, &id);
+  PROFILE_STOP(PROFILE_LOOKUP, start);
+  return id;
+}
+
+/**
+ * @param table a StateTable
+ * @param id an ID handed out by table
+ * @return the state with that ID, valid until the next state is added
+ */
+State state_table_state(const StateTable_t *const table, const int id) {
+  return &table->states[(long)(id - 1) * table->key_len];
+}
+
+/**
+ * Removes every state from table, keeping its memory for the next use. Only
+ * the slots holding an ID are emptied, latest first: the probe sequence of a
+ * state only passes states added before it, so each is still found.
+ * @param table a StateTable
+ */
+void clear_state_table(StateTable_t *table) {
+  for (int id = table->count; id > 0; --id) {
+    int found;
+    table->slots[find_slot(table, state_table_state(table, id), &found)] = 0;
+  }
+  table->count = 0;
+}
+
+/**
+ * Frees table along with the states it holds
+ * @param table a StateTable
+ */
+void free_state_table(StateTable_t *table) {
+  free(table->states);
+  free(table->slots);
+  free(table);
+}
+
+/**
+ * Finds the slot holding s, or the empty slot where s belongs
+ * @param table a StateTable
+ * @param s a state
+ * @param id destination for the ID in the slot, 0 if it is empty
+ * @return the index of the slot
+ */
+static long find_slot(const StateTable_t *const table, const State s,
+                      int *id) {
+  const long mask = table->capacity - 1;
+  long i = (long)(hash_state(s, table->key_len) & mask);
+
+  while (0 != (*id = table->slots[i]) &&
+         0 != memcmp(state_table_state(table, *id), s, table->key_len)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+/**
+ * Doubles the number of slots of table and puts the IDs back in
+ * @param table a StateTable
+ */
+static void grow_slots(StateTable_t *table) {
+  free(table->slots);
+  table->capacity *= 2;
+  table->slots = calloc(table->capacity, sizeof(int));
+  const long mask = table->capacity - 1;
+  for (int id = 1; id <= table->count; ++id) {
+    long i = (long)(hash_state(state_table_state(table, id), table->key_len) &
+                    mask);
+    while (0 != table->slots[i]) {
+      i = (i + 1) & mask;
+    }
+    table->slots[i] = id;
+  }
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2019 Lucas Meyers, Brandon Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STATETABLE_H
+#define STATETABLE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "states.h"
+
+struct StateTable {
+  char *states;
+  int *slots;
+  long capacity;
+  int count;
+  int room;
+  int key_len;
+};
+
+typedef struct StateTable StateTable_t;
+
+StateTable_t *create_state_table(const int);
+int state_table_intern(StateTable_t *, const State, int *);
+int state_table_id(const StateTable_t *const, const State);
+State state_table_state(const StateTable_t *const, const int);
+void clear_state_table(StateTable_t *);
+void free_state_table(StateTable_t *);
+
+#endif
@@ -20,19 +20,16 @@
 #include <string.h>
 
 static PyObject *error = NULL;
-static PyObject *out_stream = NULL;
 
-int print_py(const char *format, ...) {
+int print_py(void *out_stream, const char *format, va_list args) {
   int ret = -1;
   if (NULL == out_stream) {
     return ret;
   }
   char *s = malloc(201 * sizeof(char));
-  va_list args;
-  va_start(args, format);
   vsnprintf(s, 200, format, args);
 
-  PyObject_CallMethod(out_stream, "write", "(s)", s);
+  PyObject_CallMethod((PyObject *)out_stream, "write", "(s)", s);
 
   ret = strlen(s);
   free(s);
@@ -49,6 +46,7 @@ static PyObject *null_homologous_D0Q_py(PyObject *self, PyObject *args,
   PyObject *py_out_stream = NULL;
 
   Grid_t G;
+  HFKContext_t ctx;
   State state;
 
   G.arc_index = 0;
@@ -131,7 +129,8 @@ static PyObject *null_homologous_D0Q_py(PyObject *self, PyObject *args,
     free(state);
     return NULL;
   } else {
-    set_verbosity(py_verbosity);
+    init_context(&ctx);
+    ctx.verbosity = py_verbosity;
   }
 
   if (NULL == py_out_stream) {
@@ -147,10 +146,11 @@ static PyObject *null_homologous_D0Q_py(PyObject *self, PyObject *args,
     free(state);
     return NULL;
   } else {
-    out_stream = py_out_stream;
+    ctx.print = print_py;
+    ctx.print_data = py_out_stream;
   }
 
-  if (null_homologous_D0Q(state, &G)) {
+  if (null_homologous_D0Q(state, &G, &ctx)) {
     Py_RETURN_TRUE;
   } else {
     Py_RETURN_FALSE;
@@ -166,6 +166,7 @@ static PyObject *null_homologous_D1Q_py(PyObject *self, PyObject *args,
   PyObject *py_out_stream = NULL;
 
   Grid_t G;
+  HFKContext_t ctx;
   State state;
 
   G.arc_index = 0;
@@ -248,7 +249,8 @@ static PyObject *null_homologous_D1Q_py(PyObject *self, PyObject *args,
     free(state);
     return NULL;
   } else {
-    set_verbosity(py_verbosity);
+    init_context(&ctx);
+    ctx.verbosity = py_verbosity;
   }
 
   if (NULL == py_out_stream) {
@@ -264,10 +266,11 @@ static PyObject *null_homologous_D1Q_py(PyObject *self, PyObject *args,
     free(state);
     return NULL;
   } else {
-    out_stream = py_out_stream;
+    ctx.print = print_py;
+    ctx.print_data = py_out_stream;
   }
 
-  if (null_homologous_D1Q(state, &G)) {
+  if (null_homologous_D1Q(state, &G, &ctx)) {
     Py_RETURN_TRUE;
   } else {
     Py_RETURN_FALSE;
@@ -284,6 +287,7 @@ static PyObject *null_homologous_lift_py(PyObject *self, PyObject *args,
   PyObject *py_out_stream = NULL;
 
   LiftGrid_t G;
+  HFKContext_t ctx;
   Grid_t H;
   State state;
   LiftState lift_state;
@@ -389,7 +393,8 @@ static PyObject *null_homologous_lift_py(PyObject *self, PyObject *args,
     free_lift_state(&lift_state, &G);
     return NULL;
   } else {
-    set_verbosity(py_verbosity);
+    init_context(&ctx);
+    ctx.verbosity = py_verbosity;
   }
 
   if (NULL == py_out_stream) {
@@ -407,10 +412,11 @@ static PyObject *null_homologous_lift_py(PyObject *self, PyObject *args,
     free_lift_state(&lift_state, &G);
     return NULL;
   } else {
-    out_stream = py_out_stream;
+    ctx.print = print_py;
+    ctx.print_data = py_out_stream;
   }
 
-  if (null_homologous_lift(lift_state, &G)) {
+  if (null_homologous_lift(lift_state, &G, &ctx)) {
     Py_RETURN_TRUE;
   } else {
     Py_RETURN_FALSE;
@@ -487,6 +493,79 @@ verbosity : int\n\
 Note: Xs, Os, and state must be permutations {1,..,N}\n\
 where Xs and Os have no overlapping values.";
 
+static PyObject *profile_py(PyObject *self, PyObject *args) {
+  ProfileCounter_t phases[PROFILE_PHASES];
+  unsigned long long events[PROFILE_EVENTS];
+  PyObject *ans;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  if (!get_profile(phases, events)) {
+    Py_RETURN_NONE;
+  }
+
+  ans = PyDict_New();
+  for (int i = 0; i < PROFILE_PHASES; ++i) {
+    PyObject *value = Py_BuildValue("(KK)", phases[i].calls, phases[i].ticks);
+    PyDict_SetItemString(ans, profile_phase_name(i), value);
+    Py_DECREF(value);
+  }
+  for (int i = 0; i < PROFILE_EVENTS; ++i) {
+    PyObject *value = PyLong_FromUnsignedLongLong(events[i]);
+    PyDict_SetItemString(ans, profile_event_name(i), value);
+    Py_DECREF(value);
+  }
+
+  return ans;
+}
+
+static char profile_doc[] =
+    "Returns the phase timers and event counters gathered so far,\n\
+or None unless the module was built with HFK_PROFILE set.\n\
+\n\
+Each phase maps to a pair (calls, ticks), where ticks are CPU\n\
+cycles on x86 and nanoseconds elsewhere, and each event maps to\n\
+its count. Phases nest: enumerate includes the lookups it makes.";
+
+static PyObject *allocations_py(PyObject *self, PyObject *args) {
+  AllocTotals_t totals;
+  PyObject *ans, *sites;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  if (!get_allocations(&totals)) {
+    Py_RETURN_NONE;
+  }
+
+  sites = PyList_New(0);
+  for (const AllocSite_t *site = get_allocation_sites(); NULL != site;
+       site = site->next) {
+    PyObject *value = Py_BuildValue("(siKK)", site->file, site->line,
+                                    site->calls, site->bytes);
+    PyList_Append(sites, value);
+    Py_DECREF(value);
+  }
+
+  ans = Py_BuildValue("{sKsKsKsLsLsN}", "allocations", totals.allocations,
+                      "frees", totals.frees, "bytes", totals.bytes,
+                      "current", totals.current, "peak", totals.peak,
+                      "sites", sites);
+  return ans;
+}
+
+static char allocations_doc[] =
+    "Returns the allocations counted so far, or None unless the\n\
+module was built with HFK_TRACK_ALLOC set.\n\
+\n\
+The dict holds the number of allocations, frees and bytes\n\
+allocated, the bytes currently allocated and their peak, and\n\
+under 'sites' a list of (file, line, calls, bytes) for each\n\
+place in the source that allocated.";
+
 static PyMethodDef _transHFK_methods[] = {
     {"null_homologous_D0Q", (PyCFunction)null_homologous_D0Q_py,
      METH_VARARGS | METH_KEYWORDS, null_homologous_D0Q_doc},
@@ -494,6 +573,9 @@ static PyMethodDef _transHFK_methods[] = {
      METH_VARARGS | METH_KEYWORDS, null_homologous_D1Q_doc},
     {"null_homologous_lift", (PyCFunction)null_homologous_lift_py,
      METH_VARARGS | METH_KEYWORDS, null_homologous_lift_doc},
+    {"profile", (PyCFunction)profile_py, METH_VARARGS, profile_doc},
+    {"allocations", (PyCFunction)allocations_py, METH_VARARGS,
+     allocations_doc},
     {NULL, NULL}};
 
 PyMODINIT_FUNC init_transHFK(void) {
@@ -506,6 +588,4 @@ PyMODINIT_FUNC init_transHFK(void) {
   d = PyModule_GetDict(m);
   error = PyErr_NewException((char *)transHFK_dot_error, NULL, NULL);
   PyDict_SetItemString(d, transHFK_error_name, error);
-
-  set_print_fn(print_py);
 }
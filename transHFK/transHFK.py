@@ -21,6 +21,89 @@ from sys import stdout
 import multiprocessing as mp
 import _transHFK
 
+RESULT_CACHE_VERSION = "transverseHFK result cache 2"
+
+def translate(s, cols, rows):
+    """
+    Translates the state, Xs or Os s across the torus: entry i of the
+    result is entry i + cols of s raised by rows, both mod len(s).
+    """
+    n = len(s)
+    return [(s[(i+cols) % n]-1+rows) % n + 1 for i in range(n)]
+
+def canonical_grid(Xs, Os):
+    """
+    Returns the translation (Xs, Os) of the grid whose Xs followed by
+    its Os are lexicographically smallest. Matches canonical_grid of
+    the C library.
+    """
+    n = len(Xs)
+    return min((translate(Xs, c, r), translate(Os, c, r))
+               for c in range(n) for r in range(n))
+
+class ResultCache:
+    """
+    Results of the invariants kept in a file. The file has the same
+    format as the one used by transverseHFK --cache so the two may
+    share it.
+
+    Attributes
+    ----------
+    path : str
+        The file of the cache.
+    results : {str: bool}
+        The results loaded from the file, by key.
+    """
+
+    def __init__(self, path):
+        """
+        Loads the results kept in the file at path. A file written
+        by another version is started over.
+
+        Parameters
+        ----------
+        path : str
+            The file of the cache. Created if it does not exist.
+        """
+        self.path = path
+        self.results = {}
+        try:
+            with open(path) as f:
+                lines = f.read().splitlines()
+        except IOError:
+            lines = []
+        if not lines or lines[0] != RESULT_CACHE_VERSION:
+            with open(path, 'w') as f:
+                f.write(RESULT_CACHE_VERSION + '\n')
+            lines = []
+        for line in lines[1:]:
+            key, _, result = line.rpartition(' ')
+            if key and result in ('0', '1') and key not in self.results:
+                self.results[key] = (result == '1')
+
+    def key(self, Xs, Os, sheets, invariant):
+        """
+        Returns the key of an invariant of the grid (Xs, Os). The key
+        describes the canonical grid, so translations of a grid share
+        their keys.
+        """
+        Xs, Os = canonical_grid(Xs, Os)
+        return '%d %d %s %s %s' % (len(Xs), sheets,
+                                   ','.join(str(x) for x in Xs),
+                                   ','.join(str(o) for o in Os),
+                                   invariant)
+
+    def get(self, key):
+        """Returns the result kept for key, or None if there is none."""
+        return self.results.get(key)
+
+    def put(self, key, result):
+        """Keeps result for key and appends it to the file."""
+        if key not in self.results:
+            self.results[key] = bool(result)
+            with open(self.path, 'a') as f:
+                f.write('%s %d\n' % (key, int(bool(result))))
+
 class transHFK:
     """
     Class the contains the X,O code of a knot and
@@ -41,6 +124,10 @@ class transHFK:
         An integer specifying the verbosity of the methods. Must
         be 0, 1, or 2. 0 will print no information and 2 will print
         the most. Defaults to 0.
+    cache : ResultCache
+        The results of earlier calculations, consulted before each
+        invariant is calculated. None to always calculate. Defaults
+        to None.
 
     Note: For the methods to work the Xs and Os must be
     permutations {1,...,N} with nonoverlapping values.
@@ -72,7 +159,7 @@ class transHFK:
         is null-homologous. False otherwise.
     """
 
-    def __init__(self, Xs, Os, out_stream=stdout, verbosity=0):
+    def __init__(self, Xs, Os, out_stream=stdout, verbosity=0, cache=None):
         """
         Parameters
         ----------
@@ -89,6 +176,9 @@ class transHFK:
             An integer specifying the verbosity of the methods. Must
             be 0, 1, or 2. 0 will print no information and 2 will print
             the most.
+        cache : ResultCache or str
+            The results of earlier calculations, or the path of the
+            file holding them. Defaults to None.
 
         Note: For the methods to work the Xs and Os must be
         permutations {1,...,N} with nonoverlapping values.
@@ -97,6 +187,32 @@ class transHFK:
         self.Os = Os
         self.out_stream = out_stream
         self.verbosity = verbosity
+        if isinstance(cache, str):
+            cache = ResultCache(cache)
+        self.cache = cache
+
+    def _cached(self, invariant, sheets, calculate):
+        """
+        Returns the result of the invariant, looking it up in the cache
+        first if there is one and keeping it there otherwise.
+
+        Parameters
+        ----------
+        invariant : str
+            The name of the invariant.
+        sheets : int
+            The number of sheets of the cover, 1 for the grid itself.
+        calculate : fun: () -> bool
+            Calculates the invariant.
+        """
+        if self.cache is None:
+            return calculate()
+        key = self.cache.key(self.Xs, self.Os, sheets, invariant)
+        result = self.cache.get(key)
+        if result is None:
+            result = calculate()
+            self.cache.put(key, result)
+        return result
 
     def arc_index(self):
         """Returns the size of the grid."""
@@ -178,19 +294,19 @@ class transHFK:
     
     def lambda_plus(self):
         """Returns True if x+ is null-homologous. False otherwise."""
-        return _transHFK.null_homologous_D0Q(self.x_plus(), self.Xs, self.Os, self.out_stream, self.verbosity)
+        return self._cached('UR', 1, lambda: _transHFK.null_homologous_D0Q(self.x_plus(), self.Xs, self.Os, self.out_stream, self.verbosity))
 
     def lambda_minus(self):
         """Returns True if x- is null-homologous. False otherwise."""
-        return _transHFK.null_homologous_D0Q(self.x_minus(), self.Xs, self.Os, self.out_stream, self.verbosity)
+        return self._cached('LL', 1, lambda: _transHFK.null_homologous_D0Q(self.x_minus(), self.Xs, self.Os, self.out_stream, self.verbosity))
 
     def d_lambda_plus(self):
         """Returns True if d_1 x+ is null-homologous. False otherwise."""
-        return _transHFK.null_homologous_D1Q(self.x_plus(), self.Xs, self.Os, self.out_stream, self.verbosity)
+        return self._cached('D1[UR]', 1, lambda: _transHFK.null_homologous_D1Q(self.x_plus(), self.Xs, self.Os, self.out_stream, self.verbosity))
 
     def d_lambda_minus(self):
         """Returns True if d_1 x- is null-homologous. False otherwise."""
-        return _transHFK.null_homologous_D1Q(self.x_minus(), self.Xs, self.Os, self.out_stream, self.verbosity)
+        return self._cached('D1[LL]', 1, lambda: _transHFK.null_homologous_D1Q(self.x_minus(), self.Xs, self.Os, self.out_stream, self.verbosity))
 
     def theta_n(self, n):
         """
@@ -200,7 +316,7 @@ class transHFK:
         if n == 1:
             return self.lambda_plus()
         else:
-            return _transHFK.null_homologous_lift(self.x_plus(), n, self.Xs, self.Os, self.out_stream, self.verbosity)
+            return self._cached('theta', n, lambda: _transHFK.null_homologous_lift(self.x_plus(), n, self.Xs, self.Os, self.out_stream, self.verbosity))
     
 class Tk_transHFK(transHFK):
     """